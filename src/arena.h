@@ -0,0 +1,208 @@
+/**
+ * Arena: bump-pointer allocator the SkipList carves its nodes from.
+ * Memory is only handed back block by block, so dropping a whole list costs one free per block instead of one
+ * delete per node.
+ * With huge_pages, blocks are 2MB-aligned mappings: explicit MAP_HUGETLB pages when the host has some reserved,
+ * otherwise ordinary pages marked MADV_HUGEPAGE for transparent huge pages. Either way a lookup's random hops stay
+ * within far fewer TLB entries. With numa_interleave, every block is interleaved page by page across the online NUMA
+ * nodes (mbind MPOL_INTERLEAVE) before it is first touched, so no single socket serves all the misses.
+ * */
+#pragma once
+
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace skiplist {
+class Arena {
+ public:
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+  static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+  explicit Arena(size_t block_size = DEFAULT_BLOCK_SIZE, bool huge_pages = false, bool numa_interleave = false)
+      : block_size_(huge_pages ? RoundUp(block_size, HUGE_PAGE_SIZE) : block_size),
+        huge_pages_(huge_pages),
+        numa_interleave_(numa_interleave) {}
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena() {
+    for (auto block : blocks_) {
+      FreeBlock(block, block_size_);
+    }
+    for (auto &block : large_blocks_) {
+      FreeBlock(block.first, block.second);
+    }
+  }
+
+  // Return `bytes` bytes aligned to `align`, which must be a power of two. Throws std::bad_alloc when the system is out
+  // of memory, like operator new.
+  char *Allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+    assert((align & (align - 1)) == 0);
+    size_t slop = (align - (reinterpret_cast<uintptr_t>(alloc_ptr_) & (align - 1))) & (align - 1);
+    if (bytes + slop <= remaining_) {
+      char *result = alloc_ptr_ + slop;
+      alloc_ptr_ += bytes + slop;
+      remaining_ -= bytes + slop;
+      return result;
+    }
+    if (bytes > block_size_ / 4) {
+      // Big objects get their own block so the tail of the current one is not wasted.
+      size_t size = RoundUp(bytes, align);
+      char *block = AllocateBlock(size, align);
+      large_blocks_.emplace_back(block, size);
+      memory_usage_ += bytes;
+      return block;
+    }
+    NextBlock();
+    return Allocate(bytes, align);
+  }
+
+  // Rewind to the first block but keep every regular block for reuse by the next generation of allocations.
+  void Reset() {
+    for (auto &block : large_blocks_) {
+      FreeBlock(block.first, block.second);
+    }
+    large_blocks_.clear();
+    block_index_ = 0;
+    alloc_ptr_ = nullptr;
+    remaining_ = 0;
+    memory_usage_ = blocks_.size() * block_size_;
+  }
+
+  // Bytes obtained from the system allocator.
+  size_t MemoryUsage() const { return memory_usage_; }
+  // Bytes of blocks that got explicit MAP_HUGETLB pages; the rest of a huge_pages arena relies on THP.
+  size_t HugeTLBUsage() const { return hugetlb_usage_; }
+
+ private:
+  static size_t RoundUp(size_t bytes, size_t align) { return (bytes + align - 1) & ~(align - 1); }
+
+  bool Mapped() const { return huge_pages_ || numa_interleave_; }
+
+  char *AllocateBlock(size_t bytes, size_t align) {
+    if (!Mapped()) {
+      void *mem = aligned_alloc(align, RoundUp(bytes, align));
+      if (mem == nullptr) {
+        throw std::bad_alloc();
+      }
+      return static_cast<char *>(mem);
+    }
+    // mmap hands out page-aligned memory, which covers any node alignment.
+    size_t size = RoundUp(bytes, huge_pages_ ? HUGE_PAGE_SIZE : getpagesize());
+    char *block = nullptr;
+    if (huge_pages_) {
+      void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (mem != MAP_FAILED) {
+        block = static_cast<char *>(mem);
+        hugetlb_usage_ += size;
+      }
+    }
+    if (block == nullptr) {
+      if (huge_pages_) {
+        // No reserved huge pages: map 2MB extra and trim it, so the block starts on a huge page boundary.
+        void *mem = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+          throw std::bad_alloc();
+        }
+        char *raw = static_cast<char *>(mem);
+        block = reinterpret_cast<char *>(RoundUp(reinterpret_cast<uintptr_t>(raw), HUGE_PAGE_SIZE));
+        if (block != raw) {
+          munmap(raw, block - raw);
+        }
+        munmap(block + size, raw + HUGE_PAGE_SIZE - block);
+        madvise(block, size, MADV_HUGEPAGE);
+      } else {
+        void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+          throw std::bad_alloc();
+        }
+        block = static_cast<char *>(mem);
+      }
+    }
+    if (numa_interleave_) {
+      Interleave(block, size);
+    }
+    return block;
+  }
+
+  void FreeBlock(char *block, size_t bytes) {
+    if (!Mapped()) {
+      free(block);
+      return;
+    }
+    munmap(block, RoundUp(bytes, huge_pages_ ? HUGE_PAGE_SIZE : getpagesize()));
+  }
+
+  // Spread the pages of [block, block + size) over every online NUMA node. A no-op on single-node hosts.
+  static void Interleave(char *block, size_t size) {
+    static const std::vector<unsigned long> node_mask = OnlineNodes();  // NOLINT
+    if (node_mask.empty()) {
+      return;
+    }
+    syscall(SYS_mbind, block, size, MPOL_INTERLEAVE, node_mask.data(), node_mask.size() * 8 * sizeof(node_mask[0]),
+            0);
+  }
+
+  // Mask of the online NUMA nodes, parsed from a list like "0-1,3"; empty if there are fewer than two.
+  static std::vector<unsigned long> OnlineNodes() {  // NOLINT
+    std::vector<unsigned long> mask;  // NOLINT
+    std::ifstream input("/sys/devices/system/node/online");
+    std::string ranges;
+    size_t nodes = 0;
+    if (input >> ranges) {
+      size_t pos = 0;
+      while (pos < ranges.size()) {
+        size_t end = ranges.find(',', pos);
+        std::string range = ranges.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        size_t dash = range.find('-');
+        size_t first = std::stoul(range.substr(0, dash));
+        size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        for (size_t node = first; node <= last; node++) {
+          size_t word = node / (8 * sizeof(unsigned long));  // NOLINT
+          if (mask.size() <= word) {
+            mask.resize(word + 1, 0);
+          }
+          mask[word] |= 1UL << (node % (8 * sizeof(unsigned long)));  // NOLINT
+          nodes++;
+        }
+        pos = end == std::string::npos ? ranges.size() : end + 1;
+      }
+    }
+    if (nodes < 2) {
+      mask.clear();
+    }
+    return mask;
+  }
+
+  void NextBlock() {
+    if (block_index_ == blocks_.size()) {
+      blocks_.push_back(AllocateBlock(block_size_, alignof(std::max_align_t)));
+      memory_usage_ += block_size_;
+    }
+    alloc_ptr_ = blocks_[block_index_++];
+    remaining_ = block_size_;
+  }
+
+  size_t block_size_;
+  bool huge_pages_;
+  bool numa_interleave_;
+  std::vector<char *> blocks_;
+  std::vector<std::pair<char *, size_t>> large_blocks_;  // with their sizes, which munmap needs
+  size_t block_index_{0};  // next block of blocks_ to hand out
+  char *alloc_ptr_{nullptr};
+  size_t remaining_{0};
+  size_t memory_usage_{0};
+  size_t hugetlb_usage_{0};
+};
+}  // namespace skiplist
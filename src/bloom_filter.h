@@ -0,0 +1,104 @@
+/**
+ * CountingBloomFilter: approximate membership with 4-bit counters, so keys can be deleted again.
+ * Probe positions come from one MurmurHash3_x64_128 call split into two halves (double hashing). A counter that
+ * reaches 15 sticks there, trading a little accuracy for never producing a false negative.
+ * Updates must be serialized by the caller; MayContain may run concurrently with them.
+ * */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+#include "murmur3/MurmurHash3.h"
+
+namespace skiplist {
+class CountingBloomFilter {
+  static const uint8_t COUNTER_MAX = 15;
+
+ public:
+  CountingBloomFilter(size_t expected_keys, size_t cells_per_key) {
+    cells_ = std::max<size_t>(expected_keys * cells_per_key, 64);
+    // k = ln2 * m / n minimizes the false positive rate.
+    probes_ = std::min<size_t>(std::max<size_t>(static_cast<size_t>(cells_per_key * 0.69), 1), 30);
+    counters_.reset(new std::atomic<uint8_t>[(cells_ + 1) / 2]);
+    Clear();
+  }
+
+  void Add(const void *key, size_t len) {
+    uint64_t h1;
+    uint64_t h2;
+    Hash(key, len, &h1, &h2);
+    for (size_t i = 0; i < probes_; i++) {
+      size_t cell = (h1 + i * h2) % cells_;
+      uint8_t count = Get(cell);
+      if (count < COUNTER_MAX) {
+        Set(cell, count + 1);
+      }
+    }
+  }
+
+  void Delete(const void *key, size_t len) {
+    uint64_t h1;
+    uint64_t h2;
+    Hash(key, len, &h1, &h2);
+    for (size_t i = 0; i < probes_; i++) {
+      size_t cell = (h1 + i * h2) % cells_;
+      uint8_t count = Get(cell);
+      if (count > 0 && count < COUNTER_MAX) {
+        Set(cell, count - 1);
+      }
+    }
+  }
+
+  bool MayContain(const void *key, size_t len) const {
+    uint64_t h1;
+    uint64_t h2;
+    Hash(key, len, &h1, &h2);
+    for (size_t i = 0; i < probes_; i++) {
+      if (Get((h1 + i * h2) % cells_) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Clear() {
+    for (size_t i = 0; i < (cells_ + 1) / 2; i++) {
+      counters_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // False positive rate expected once `keys` keys have been added.
+  double ExpectedFalsePositiveRate(size_t keys) const {
+    return std::pow(1 - std::exp(-static_cast<double>(probes_) * keys / cells_), probes_);
+  }
+
+  size_t MemoryUsage() const { return (cells_ + 1) / 2; }
+
+ private:
+  static void Hash(const void *key, size_t len, uint64_t *h1, uint64_t *h2) {
+    uint64_t out[2];
+    murmur3::MurmurHash3_x64_128(key, static_cast<int>(len), 0, out);
+    *h1 = out[0];
+    *h2 = out[1] | 1;  // odd, so the probes never collapse onto one cell
+  }
+
+  uint8_t Get(size_t cell) const {
+    uint8_t byte = counters_[cell / 2].load(std::memory_order_relaxed);
+    return cell % 2 == 0 ? byte & 0x0f : byte >> 4;
+  }
+
+  void Set(size_t cell, uint8_t count) {
+    uint8_t byte = counters_[cell / 2].load(std::memory_order_relaxed);
+    byte = cell % 2 == 0 ? (byte & 0xf0) | count : (byte & 0x0f) | (count << 4);
+    counters_[cell / 2].store(byte, std::memory_order_relaxed);
+  }
+
+  size_t cells_;
+  size_t probes_;
+  std::unique_ptr<std::atomic<uint8_t>[]> counters_;  // two 4-bit counters per byte
+};
+}  // namespace skiplist
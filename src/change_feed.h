@@ -0,0 +1,156 @@
+/**
+ * ChangeFeed: a bounded ring of change records for mirroring a SkipList incrementally.
+ * The list appends one record per change it makes, under its write latch, so there is exactly one producer at any
+ * time and appending is a plain slot write plus two release stores: it never waits for a consumer. Subscribers read
+ * at their own pace without any latch. Every slot carries the sequence number of the record in it, written last, so a
+ * reader copies the record and then checks that the slot still holds the same sequence (a seqlock). A subscriber more
+ * than capacity records behind finds its next records overwritten: it skips to the oldest record still in the ring,
+ * counts the lost ones in Dropped() and sees Overflowed() until it calls Resync(), after which it is expected to have
+ * rebuilt its mirror from a scan.
+ * KeyType and ValueType must be trivially copyable: readers copy slots that the producer may be overwriting.
+ * */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace skiplist {
+
+// CLEAR drops every key at once (Clear, Reset); its key and value mean nothing.
+enum class ChangeOp : uint8_t { INSERT, REMOVE, CLEAR };
+
+template <typename KeyType, typename ValueType>
+struct ChangeRecord {
+  uint64_t seq_;  // 0 for the first record the feed took, then one more for each
+  ChangeOp op_;
+  KeyType key_;
+  ValueType value_;  // for REMOVE, the value the key had
+};
+
+template <typename KeyType, typename ValueType>
+class ChangeFeed : public std::enable_shared_from_this<ChangeFeed<KeyType, ValueType>> {
+  static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                "readers copy slots while they may be rewritten");
+
+ public:
+  using Record = ChangeRecord<KeyType, ValueType>;
+  static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+
+  // capacity is rounded up to a power of two.
+  explicit ChangeFeed(size_t capacity = DEFAULT_CAPACITY) {
+    size_t slots = 1;
+    while (slots < capacity) {
+      slots <<= 1;
+    }
+    slots_ = std::vector<Slot>(slots);
+    mask_ = slots - 1;
+  }
+  ChangeFeed(const ChangeFeed &) = delete;
+  ChangeFeed &operator=(const ChangeFeed &) = delete;
+
+  // Producer side; the caller makes sure there is one producer at a time.
+  void Append(ChangeOp op, const KeyType &key, const ValueType &value) {
+    uint64_t seq = head_.load(std::memory_order_relaxed);
+    auto &slot = slots_[seq & mask_];
+    // Readers of the record this one replaces must see the slot change before its contents do.
+    slot.seq_.store(EMPTY, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Record record{seq, op, key, value};
+    memcpy(&slot.record_, &record, sizeof(Record));
+    slot.seq_.store(seq, std::memory_order_release);
+    head_.store(seq + 1, std::memory_order_release);
+  }
+
+  // Sequence number the next record will get, i.e. how many records the feed has taken.
+  uint64_t Head() const { return head_.load(std::memory_order_acquire); }
+  size_t Capacity() const { return slots_.size(); }
+
+  class Subscriber {
+   public:
+    // Copy up to max_records records, oldest first, to the back of out and return how many.
+    size_t Poll(std::vector<Record> *out, size_t max_records) {
+      size_t count = 0;
+      while (count < max_records) {
+        uint64_t head = feed_->Head();
+        if (next_ == head) {
+          break;
+        }
+        if (head - next_ > feed_->Capacity()) {
+          SkipTo(head - feed_->Capacity());
+          continue;
+        }
+        Record record;
+        if (!feed_->Read(next_, &record)) {
+          // Overwritten while we were at it: the producer is a whole ring ahead.
+          SkipTo(next_ + 1);
+          continue;
+        }
+        out->push_back(record);
+        next_++;
+        count++;
+      }
+      return count;
+    }
+
+    // Records taken by the feed that this subscriber has not polled yet.
+    uint64_t Lag() const { return feed_->Head() - next_; }
+    // Sequence number of the next record to poll.
+    uint64_t Position() const { return next_; }
+    // Records lost to overflow so far.
+    uint64_t Dropped() const { return dropped_; }
+    bool Overflowed() const { return overflowed_; }
+    // Forget the backlog and the overflow, and go on from the next record appended: call it right before a full scan
+    // that rebuilds the mirror, and replay the records polled after the scan on top of it.
+    void Resync() {
+      next_ = feed_->Head();
+      overflowed_ = false;
+    }
+
+   private:
+    friend class ChangeFeed;
+    Subscriber(std::shared_ptr<ChangeFeed> feed, uint64_t next) : feed_(std::move(feed)), next_(next) {}
+    void SkipTo(uint64_t seq) {
+      dropped_ += seq - next_;
+      next_ = seq;
+      overflowed_ = true;
+    }
+
+    std::shared_ptr<ChangeFeed> feed_;  // kept alive by its subscribers, also past the list
+    uint64_t next_;
+    uint64_t dropped_{0};
+    bool overflowed_{false};
+  };
+
+  // A subscriber that starts with the next record appended.
+  std::unique_ptr<Subscriber> Subscribe() {
+    return std::unique_ptr<Subscriber>(new Subscriber(this->shared_from_this(), Head()));
+  }
+
+ private:
+  static constexpr uint64_t EMPTY = ~uint64_t{0};
+
+  struct Slot {
+    std::atomic<uint64_t> seq_{EMPTY};  // sequence number of record_, EMPTY while it is being written
+    Record record_;
+  };
+
+  // Copy record seq out of its slot; false if the slot holds another record by the end of the copy.
+  bool Read(uint64_t seq, Record *record) const {
+    const auto &slot = slots_[seq & mask_];
+    if (slot.seq_.load(std::memory_order_acquire) != seq) {
+      return false;
+    }
+    memcpy(static_cast<void *>(record), &slot.record_, sizeof(Record));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq_.load(std::memory_order_relaxed) == seq;
+  }
+
+  std::vector<Slot> slots_;
+  uint64_t mask_;
+  std::atomic<uint64_t> head_{0};
+};
+}  // namespace skiplist
@@ -0,0 +1,283 @@
+#include "compact_skiplist.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace skiplist {
+template <typename KeyType, typename ValueType, typename KeyComparator>
+COMPACT_SKIPLIST_TYPE::CompactSkipList(const KeyComparator &comparator, size_t max_height, size_t branching,
+                                       size_t rnd)
+    : CompactSkipList(comparator, std::unique_ptr<OffsetArena>(new OffsetArena()), max_height, branching, rnd) {}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+COMPACT_SKIPLIST_TYPE::CompactSkipList(const KeyComparator &comparator, std::unique_ptr<OffsetArena> arena,
+                                       size_t max_height, size_t branching, size_t rnd)
+    : comparator_(comparator), max_height_(max_height), branching_(branching), rnd_(rnd), arena_(std::move(arena)) {
+  LOG_INFO("Construct CompactSkipList with max_height: %lu and random seed: %lu", max_height, rnd);
+  assert(max_height < 256);
+  srand(rnd_);
+  if (arena_->Root() != 0) {
+    // A list from an earlier process: take its shape from Meta.
+    auto meta = arena_->At<Meta>(arena_->Root());
+    if (meta->magic_ != Meta::MAGIC || meta->key_size_ != sizeof(KeyType) || meta->value_size_ != sizeof(ValueType)) {
+      LOG_WARN("The arena holds no CompactSkipList of this type");
+      return;
+    }
+    meta_ = arena_->Root();
+    max_height_ = meta->max_height_;
+    branching_ = meta->branching_;
+    head_ = meta->head_;
+    update_.resize(max_height_);
+    if (meta->intent_ != Meta::NONE) {
+      Recover();
+    }
+    return;
+  }
+  // Meta goes first, right behind the arena header, so PersistMeta covers both with one range.
+  meta_ = arena_->Allocate(Meta::AllocSize(max_height_));
+  assert(meta_ != 0 && static_cast<size_t>(meta_) * OffsetArena::GRANULE % alignof(Meta) == 0);
+  auto meta = new (GetMeta()) Meta{Meta::MAGIC,
+                                   0,
+                                   sizeof(KeyType),
+                                   sizeof(ValueType),
+                                   static_cast<uint32_t>(max_height_),
+                                   static_cast<uint32_t>(branching_),
+                                   0,
+                                   Meta::NONE,
+                                   0,
+                                   0};
+  for (size_t level = 0; level < max_height_; level++) {
+    meta->FreeNodes()[level] = 0;
+  }
+  head_ = CreateNode(max_height_, KeyType{}, ValueType{});
+  for (size_t level = 0; level < max_height_; level++) {
+    Node(head_)->Forward()[level] = 0;
+  }
+  GetMeta()->head_ = head_;
+  arena_->Persist(head_, CompactNode::AllocSize(max_height_));
+  PersistMeta();
+  // The root makes the list visible to the next Open, so it comes last.
+  arena_->SetRoot(meta_);
+  arena_->PersistHeader();
+  update_.resize(max_height_);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+std::unique_ptr<COMPACT_SKIPLIST_TYPE> COMPACT_SKIPLIST_TYPE::Open(const std::string &file_name,
+                                                                   const KeyComparator &comparator,
+                                                                   size_t max_height, size_t branching, bool sync) {
+  auto arena = OffsetArena::Open(file_name, sync);
+  if (arena == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<CompactSkipList> list(new CompactSkipList(comparator, std::move(arena), max_height, branching,
+                                                            0xdeadbeef));
+  if (list->meta_ == 0) {
+    return nullptr;
+  }
+  return list;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void COMPACT_SKIPLIST_TYPE::Recover() {
+  auto meta = GetMeta();
+  uint32_t offset = meta->intent_node_;
+  KeyType key = Node(offset)->key_;
+  // update_ gets the predecessors; level 0 tells whether the node is still, or already, in the list.
+  bool linked = FindPath(key) == offset;
+  LOG_WARN("Recover an interrupted %s", meta->intent_ == Meta::INSERT ? "Insert" : "Remove");
+  auto node = Node(offset);
+  if (meta->intent_ == Meta::INSERT) {
+    if (linked) {
+      // Level 0 made it: link the levels above that did not.
+      for (size_t level = 1; level < node->height_; level++) {
+        auto prev = Node(update_[level]);
+        if (prev->Forward()[level] != offset) {
+          node->Forward()[level] = prev->Forward()[level];
+          PersistLink(offset, level);
+          prev->Forward()[level] = offset;
+          PersistLink(update_[level], level);
+        }
+      }
+    } else if (meta->FreeNodes()[node->height_ - 1] != offset) {
+      // Not freed yet by an earlier, interrupted recovery: freeing twice would loop the free list.
+      FreeNode(offset);
+    }
+    meta->size_ = meta->intent_size_ + (linked ? 1 : 0);
+  } else {
+    for (int level = node->height_ - 1; level >= 0; level--) {
+      auto prev = Node(update_[level]);
+      if (prev->Forward()[level] == offset) {
+        prev->Forward()[level] = node->Forward()[level];
+        PersistLink(update_[level], level);
+      }
+    }
+    if (meta->FreeNodes()[node->height_ - 1] != offset) {
+      FreeNode(offset);
+    }
+    meta->size_ = meta->intent_size_ - 1;
+  }
+  meta->intent_ = Meta::NONE;
+  PersistMeta();
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+uint32_t COMPACT_SKIPLIST_TYPE::FindPath(const KeyType &key) {
+  auto cur = Node(head_);
+  uint32_t cur_offset = head_;
+  uint32_t next = 0;
+  for (int level = max_height_ - 1; level >= 0; level--) {
+    next = cur->Forward()[level];
+    while (next != 0 && comparator_(Node(next)->key_, key) < 0) {
+      cur_offset = next;
+      cur = Node(next);
+      next = cur->Forward()[level];
+    }
+    update_[level] = cur_offset;
+  }
+  return next;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool COMPACT_SKIPLIST_TYPE::Lookup(const KeyType &key, std::vector<ValueType> *result) {
+  rwlatch_.RLock();
+  LOG_INFO("Lookup: <%ld>", key.ToInteger());
+  auto cur = Node(head_);
+  for (int level = max_height_ - 1; level >= 0; level--) {
+    uint32_t next = cur->Forward()[level];
+    while (next != 0) {
+      auto p = Node(next);
+      int cmp = comparator_(p->key_, key);
+      if (cmp == 0) {
+        result->push_back(p->value_);
+        rwlatch_.RUnLock();
+        return true;
+      }
+      if (cmp > 0) {
+        break;
+      }
+      cur = p;
+      next = p->Forward()[level];
+    }
+  }
+  rwlatch_.RUnLock();
+  return false;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool COMPACT_SKIPLIST_TYPE::Insert(const KeyType &key, const ValueType &value) {
+  rwlatch_.WLock();
+  uint32_t next = FindPath(key);
+  if (next != 0 && comparator_(Node(next)->key_, key) == 0) {
+    LOG_WARN("The key: %lu has already existed!", key.ToInteger());
+    rwlatch_.WUnLock();
+    return false;
+  }
+  size_t height = RandomHeight();
+  uint32_t offset = CreateNode(height, key, value);
+  if (offset == 0) {
+    LOG_WARN("CompactSkipList is out of offsets");
+    rwlatch_.WUnLock();
+    return false;
+  }
+  // The height goes to disk first, Recover needs it to free the node. The links wait for the intent: a node taken
+  // from a free list still chains it through its first link until Meta, which no longer lists it, is persisted.
+  arena_->Persist(offset, sizeof(CompactNode));
+  auto meta = GetMeta();
+  meta->intent_node_ = offset;
+  meta->intent_size_ = meta->size_;
+  meta->intent_ = Meta::INSERT;
+  PersistMeta();
+  // Resolved only now, the allocation may have moved the arena.
+  auto node = Node(offset);
+  for (size_t level = 0; level < height; level++) {
+    node->Forward()[level] = Node(update_[level])->Forward()[level];
+  }
+  arena_->Persist(offset, CompactNode::AllocSize(height));
+  for (size_t level = 0; level < height; level++) {
+    Node(update_[level])->Forward()[level] = offset;
+    PersistLink(update_[level], level);
+  }
+  meta->size_ = meta->intent_size_ + 1;
+  meta->intent_ = Meta::NONE;
+  PersistMeta();
+  rwlatch_.WUnLock();
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool COMPACT_SKIPLIST_TYPE::Remove(const KeyType &key) {
+  rwlatch_.WLock();
+  LOG_INFO("Remove: %ld", key.ToInteger());
+  uint32_t offset = FindPath(key);
+  if (offset == 0 || comparator_(Node(offset)->key_, key) != 0) {
+    LOG_WARN("The key is not exists.");
+    rwlatch_.WUnLock();
+    return false;
+  }
+  auto meta = GetMeta();
+  meta->intent_node_ = offset;
+  meta->intent_size_ = meta->size_;
+  meta->intent_ = Meta::REMOVE;
+  PersistMeta();
+  auto node = Node(offset);
+  for (int level = node->height_ - 1; level >= 0; level--) {
+    Node(update_[level])->Forward()[level] = node->Forward()[level];
+    PersistLink(update_[level], level);
+  }
+  FreeNode(offset);
+  meta->size_ = meta->intent_size_ - 1;
+  meta->intent_ = Meta::NONE;
+  PersistMeta();
+  rwlatch_.WUnLock();
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+uint32_t COMPACT_SKIPLIST_TYPE::CreateNode(size_t height, const KeyType &key, const ValueType &value) {
+  uint32_t *free_nodes = GetMeta()->FreeNodes();
+  uint32_t offset = free_nodes[height - 1];
+  if (offset != 0) {
+    free_nodes[height - 1] = Node(offset)->Forward()[0];
+  } else {
+    offset = arena_->Allocate(CompactNode::AllocSize(height));
+    if (offset == 0) {
+      return 0;
+    }
+  }
+  new (Node(offset)) CompactNode{key, value, static_cast<uint8_t>(height)};
+  return offset;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void COMPACT_SKIPLIST_TYPE::FreeNode(uint32_t offset) {
+  auto node = Node(offset);
+  uint32_t *free_nodes = GetMeta()->FreeNodes();
+  node->Forward()[0] = free_nodes[node->height_ - 1];
+  PersistLink(offset, 0);
+  free_nodes[node->height_ - 1] = offset;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+size_t COMPACT_SKIPLIST_TYPE::RandomHeight() {
+  // Increase height with probablility 1 in kBranching
+  size_t height = 1;
+  while (height < max_height_ && (size_t)rand() < (RAND_MAX / branching_)) {
+    height += 1;
+  }
+  return height;
+}
+
+////////////////// Iterator /////////////////
+template <typename KeyType, typename ValueType, typename KeyComparator>
+typename COMPACT_SKIPLIST_TYPE::Iterator COMPACT_SKIPLIST_TYPE::begin() {
+  return Iterator{Node(head_)->Forward()[0], this};
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+typename COMPACT_SKIPLIST_TYPE::Iterator COMPACT_SKIPLIST_TYPE::end() {
+  return Iterator{0, this};
+}
+
+template class CompactSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+}  // namespace skiplist
@@ -0,0 +1,161 @@
+/**
+ * CompactSkipList: a skiplist for small keys and values whose nodes link to each other by 32-bit OffsetArena offsets.
+ * A node is its key, its value, a one-byte height and height 4-byte links, with no pointer to a separate link array,
+ * so an 8-byte key with an 8-byte value takes about 28 bytes instead of the ~90 of a SkipList node (which also keeps
+ * spans, a back link and an expiry time). More of the index fits in cache. Since links are offsets, the arena is free
+ * to grow by moving its whole mapping.
+ * Nothing in the arena is a pointer, so it can just as well be a file: Open() maps a list that a previous process
+ * built and hands it back as it was, with no reload. Insert and Remove keep it crash-consistent in three steps:
+ *   1. persist an intent record (node, old size) in Meta, along with the new node's removal from its free list, and
+ *      only then write the new node's links, while it is still unreachable;
+ *   2. change the links one at a time, persisting each: Insert bottom-up, so level 0, which decides membership, goes
+ *      first; Remove top-down, so level 0 goes last. Every prefix of these steps is a valid skiplist;
+ *   3. persist the new size with the intent cleared.
+ * Open() finds a pending intent and redoes the operation from where it stopped, guided by whether the node is still
+ * on level 0. A crash can at worst leak one node's slot.
+ * KeyType and ValueType must be trivially copyable with an alignment of at most OffsetArena::GRANULE.
+ * */
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "generic_key.h"
+#include "logger.h"
+#include "offset_arena.h"
+#include "rwlatch.h"
+
+namespace skiplist {
+
+#define COMPACT_SKIPLIST_TYPE CompactSkipList<KeyType, ValueType, KeyComparator>
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class CompactSkipList {
+  static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                "nodes are moved around with the arena");
+  static_assert(alignof(KeyType) <= OffsetArena::GRANULE && alignof(ValueType) <= OffsetArena::GRANULE,
+                "nodes are only aligned to the arena granule");
+
+ public:
+  explicit CompactSkipList(const KeyComparator &comparator, size_t max_height = 5, size_t branching = 2,
+                           size_t rnd = 0xdeadbeef);
+  // Map the list kept in file_name, creating an empty one (with max_height and branching) if the file does not exist;
+  // an existing list keeps its own shape. sync makes every step durable on disk before the next one (see
+  // OffsetArena::Persist). nullptr if the file cannot be mapped or holds something else.
+  static std::unique_ptr<CompactSkipList> Open(const std::string &file_name, const KeyComparator &comparator,
+                                               size_t max_height = 5, size_t branching = 2, bool sync = true);
+
+  // Fails on a duplicate key, and once the arena is out of offsets.
+  bool Insert(const KeyType &key, const ValueType &value);
+  bool Remove(const KeyType &key);
+  bool Lookup(const KeyType &key, std::vector<ValueType> *result);
+
+  size_t Size() { return GetMeta()->size_; }
+  // Arena bytes handed out to nodes, removed ones included until their slot is reused.
+  size_t ApproximateMemoryUsage() { return arena_->MemoryUsage(); }
+
+ private:
+  struct alignas(OffsetArena::GRANULE) CompactNode {
+    KeyType key_;
+    ValueType value_;
+    uint8_t height_;
+
+    uint32_t *Forward() { return reinterpret_cast<uint32_t *>(this + 1); }
+    static size_t AllocSize(size_t height) { return sizeof(CompactNode) + height * sizeof(uint32_t); }
+  };
+
+  // Everything besides the nodes that a reopened list needs, at the arena root.
+  struct Meta {
+    static constexpr uint64_t MAGIC = 0x636f6d7061637431;  // "compact1"
+    enum Intent : uint32_t { NONE = 0, INSERT, REMOVE };
+
+    uint64_t magic_;
+    uint64_t size_;
+    uint32_t key_size_;
+    uint32_t value_size_;
+    uint32_t max_height_;
+    uint32_t branching_;
+    uint32_t head_;
+    // The Insert or Remove in flight, see Recover().
+    uint32_t intent_;
+    uint32_t intent_node_;
+    uint64_t intent_size_;  // size before it
+
+    // Free list heads, one per height, chained through the first link of the removed nodes.
+    uint32_t *FreeNodes() { return reinterpret_cast<uint32_t *>(this + 1); }
+    static size_t AllocSize(size_t max_height) { return sizeof(Meta) + max_height * sizeof(uint32_t); }
+  };
+
+  CompactSkipList(const KeyComparator &comparator, std::unique_ptr<OffsetArena> arena, size_t max_height,
+                  size_t branching, size_t rnd);
+  CompactNode *Node(uint32_t offset) const { return arena_->At<CompactNode>(offset); }
+  Meta *GetMeta() const { return arena_->At<Meta>(meta_); }
+  // The arena header and Meta, which sit next to each other at the front.
+  void PersistMeta() {
+    arena_->Persist(0, static_cast<size_t>(meta_) * OffsetArena::GRANULE + Meta::AllocSize(max_height_));
+  }
+  void PersistLink(uint32_t offset, size_t level) {
+    arena_->Persist(offset, sizeof(CompactNode) + (level + 1) * sizeof(uint32_t));
+  }
+  // Finish the operation recorded in Meta by a process that died in the middle of it.
+  void Recover();
+  size_t RandomHeight();
+  // Offset of a node of the given height, 0 if the arena is full. Its links are left as they were: a node reused from
+  // a free list must keep its first link until the pop is persisted.
+  uint32_t CreateNode(size_t height, const KeyType &key, const ValueType &value);
+  // Push an unreachable node onto its free list.
+  void FreeNode(uint32_t offset);
+  // Fill update_ with the predecessor of key at every level and return the first node >= key (0 if none).
+  uint32_t FindPath(const KeyType &key);
+
+  /************** Iterator Unit **********************/
+ private:
+  class Iterator {
+    using KVPAIR = std::pair<const KeyType &, ValueType &>;
+
+   public:
+    Iterator(uint32_t offset, const CompactSkipList *list) : cur(offset), list(list) {}
+
+    KVPAIR operator*() const {
+      assert(cur != 0);
+      auto node = list->Node(cur);
+      return KVPAIR{node->key_, node->value_};
+    }
+
+    Iterator &operator++() {
+      assert(cur != 0);
+      cur = list->Node(cur)->Forward()[0];
+      return *this;
+    }
+    bool operator==(const Iterator &itr) const { return cur == itr.cur; }
+    bool operator!=(const Iterator &itr) const { return cur != itr.cur; }
+    ~Iterator() = default;
+
+   private:
+    uint32_t cur;
+    const CompactSkipList *list;
+  };
+
+ public:
+  Iterator begin();
+  Iterator end();
+
+ private:
+  KeyComparator comparator_;
+  size_t max_height_;
+  size_t branching_;
+  size_t rnd_;
+  ReaderWriterLatch rwlatch_;
+  std::unique_ptr<OffsetArena> arena_;
+  uint32_t meta_{0};  // 0 if the arena held no valid list
+  uint32_t head_{0};
+  // Offsets, not pointers: an Allocate may move the arena in the middle of an Insert.
+  std::vector<uint32_t> update_;
+};
+
+}  // namespace skiplist
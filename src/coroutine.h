@@ -0,0 +1,175 @@
+/**
+ * Coroutine support for the asynchronous SkipList API (see SkipList::LookupAsync).
+ * Task<T> is a lazily started coroutine that hands its result to whoever co_awaits it. InterleavedExecutor runs many
+ * tasks on one thread: a task that co_awaits Yield() goes to the back of the ready queue, so while one lookup waits on
+ * the cache line it just prefetched, the others make progress. Only built when the compiler implements coroutines
+ * (C++20, or -fcoroutines under C++17).
+ * */
+#pragma once
+
+#ifdef __cpp_impl_coroutine
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace skiplist {
+template <typename T>
+class Task;
+
+namespace detail {
+struct PromiseBase {
+  // Resume whoever awaits the task once it is done; a spawned task just stays suspended until the executor drops it.
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      auto continuation = handle.promise().continuation_;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  FinalAwaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() { std::terminate(); }
+
+  std::coroutine_handle<> continuation_;
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+  Task<T> get_return_object();
+  void return_value(T value) { value_ = std::move(value); }
+
+  T value_{};
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+  Task<void> get_return_object();
+  void return_void() {}
+};
+}  // namespace detail
+
+template <typename T>
+class Task {
+ public:
+  using promise_type = detail::Promise<T>;
+
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+  Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  // co_await starts the task and resumes the awaiting coroutine with its result.
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    handle_.promise().continuation_ = awaiting;
+    return handle_;
+  }
+  T await_resume() {
+    if constexpr (!std::is_void_v<T>) {
+      return std::move(handle_.promise().value_);
+    }
+  }
+
+  // Give up ownership of the coroutine frame, to an executor.
+  std::coroutine_handle<promise_type> Release() { return std::exchange(handle_, nullptr); }
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+template <typename T>
+Task<T> detail::Promise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::Promise<void>::get_return_object() {
+  return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+class InterleavedExecutor {
+ public:
+  InterleavedExecutor() = default;
+  InterleavedExecutor(const InterleavedExecutor &) = delete;
+  InterleavedExecutor &operator=(const InterleavedExecutor &) = delete;
+  ~InterleavedExecutor() {
+    for (auto handle : owned_) {
+      handle.destroy();
+    }
+  }
+
+  // Queue a task; it starts on the next Run().
+  template <typename T>
+  void Spawn(Task<T> task) {
+    auto handle = task.Release();
+    owned_.push_back(handle);
+    ready_.push_back(handle);
+  }
+
+  // Resume ready tasks round robin until every one has finished, then free them.
+  void Run() {
+    InterleavedExecutor *outer = std::exchange(Current(), this);
+    while (!ready_.empty()) {
+      auto handle = ready_.front();
+      ready_.pop_front();
+      handle.resume();
+    }
+    Current() = outer;
+    for (auto handle : owned_) {
+      handle.destroy();
+    }
+    owned_.clear();
+  }
+
+  // Awaitable that lets the other tasks run first.
+  struct YieldAwaiter {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { executor_->ready_.push_back(handle); }
+    void await_resume() const noexcept {}
+
+    InterleavedExecutor *executor_;
+  };
+  YieldAwaiter Yield() { return YieldAwaiter{this}; }
+
+  // Awaitable for a task that waits on another thread, such as a latch held by a writer: it goes to the back of the
+  // queue like Yield, and counts as blocked until it runs again.
+  struct BlockAwaiter {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      executor_->blocked_++;
+      executor_->ready_.push_back(handle);
+    }
+    void await_resume() const noexcept { executor_->blocked_--; }
+
+    InterleavedExecutor *executor_;
+  };
+  BlockAwaiter Block() { return BlockAwaiter{this}; }
+  // True when every other queued task is blocked as well. Nothing on this thread can make progress then, so the
+  // running task should wait for the other thread by blocking the thread, rather than spin through the queue.
+  bool OthersBlocked() const { return blocked_ == ready_.size(); }
+
+  // Executor running on this thread, nullptr outside Run().
+  static InterleavedExecutor *&Current() {
+    static thread_local InterleavedExecutor *current = nullptr;
+    return current;
+  }
+
+ private:
+  std::deque<std::coroutine_handle<>> ready_;
+  size_t blocked_{0};  // tasks in ready_ suspended by Block()
+  std::vector<std::coroutine_handle<>> owned_;
+};
+}  // namespace skiplist
+
+#endif  // __cpp_impl_coroutine
@@ -0,0 +1,214 @@
+/**
+ * FileLoader: the parsing half of SkipList::LoadFromFile.
+ * The file is mapped read-only and cut into one chunk per thread, text chunks at a line break and binary chunks at a
+ * record boundary. Every thread parses its chunk with a hand-rolled integer parser and sorts it with the list's
+ * comparator; the list then merges the sorted chunks straight into its insert path. The sort is stable and chunks
+ * keep file order, so when a key repeats, the first occurrence in the file wins, as it would with one Insert per line.
+ * Formats:
+ *   TEXT    one "key value" pair of decimal integers per line, blanks and blank lines ignored
+ *   BINARY  RECORD_SIZE-byte records, the key then the value, each a little-endian int64
+ * */
+#pragma once
+
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+namespace skiplist {
+
+enum class FileFormat { TEXT, BINARY };
+
+// What one load did. Throughput counts file bytes over the whole load, merge and inserts included.
+struct LoadStats {
+  size_t bytes_{0};
+  size_t records_{0};         // pairs parsed
+  size_t inserted_{0};        // pairs that made it into the list
+  double parse_seconds_{0};   // mapping, parsing and sorting
+  double seconds_{0};         // the whole load
+
+  double MBPerSecond() const { return seconds_ > 0 ? bytes_ / seconds_ / (1 << 20) : 0; }
+};
+
+// A whole file mapped read-only.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  bool Open(const std::string &file_name) {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    size_ = ok ? st.st_size : 0;
+    if (ok && size_ != 0) {
+      void *mem = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      ok = mem != MAP_FAILED;
+      data_ = ok ? static_cast<const char *>(mem) : nullptr;
+      if (ok) {
+        // One pass front to back, per chunk.
+        madvise(mem, size_, MADV_SEQUENTIAL);
+      }
+    }
+    close(fd);
+    return ok;
+  }
+  const char *Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+ private:
+  const char *data_{nullptr};
+  size_t size_{0};
+};
+
+// Skip blanks and line breaks, then parse an optionally signed decimal integer. False if there is none before end, or
+// if it does not fit in an int64_t.
+inline bool ParseInt64(const char **pos, const char *end, int64_t *result) {
+  const char *p = *pos;
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+    p++;
+  }
+  // Left here when there is no number, so the caller can tell the end from garbage.
+  *pos = p;
+  bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    p++;
+  }
+  const char *digits = p;
+  // The magnitude of INT64_MIN is one more than INT64_MAX.
+  const uint64_t limit = static_cast<uint64_t>(INT64_MAX) + (negative ? 1 : 0);
+  uint64_t value = 0;
+  while (p < end && static_cast<unsigned>(*p - '0') < 10) {
+    unsigned digit = *p - '0';
+    if (value > (limit - digit) / 10) {
+      return false;
+    }
+    value = value * 10 + digit;
+    p++;
+  }
+  if (p == digits) {
+    return false;
+  }
+  *pos = p;
+  *result = negative && value != 0 ? -static_cast<int64_t>(value - 1) - 1 : static_cast<int64_t>(value);
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class FileLoader {
+ public:
+  using Entry = std::pair<KeyType, ValueType>;
+  static constexpr size_t RECORD_SIZE = 2 * sizeof(int64_t);
+  // Chunks smaller than this are not worth a thread.
+  static constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+  // Parse file_name into sorted runs, one per chunk and in file order. False if the file cannot be mapped or does not
+  // follow the format.
+  static bool Parse(const std::string &file_name, FileFormat format, size_t threads, const KeyComparator &comparator,
+                    std::vector<std::vector<Entry>> *runs, LoadStats *stats) {
+    MappedFile file;
+    if (!file.Open(file_name)) {
+      return false;
+    }
+    const char *data = file.Data();
+    size_t size = file.Size();
+    stats->bytes_ = size;
+    if (format == FileFormat::BINARY && size % RECORD_SIZE != 0) {
+      return false;
+    }
+    size_t chunks = std::max<size_t>(1, std::min(threads, size / MIN_CHUNK_SIZE));
+    // bounds[i] is where chunk i starts.
+    std::vector<size_t> bounds{0};
+    for (size_t i = 1; i < chunks; i++) {
+      size_t bound = std::max(bounds.back(), size / chunks * i);
+      if (format == FileFormat::BINARY) {
+        bound -= bound % RECORD_SIZE;
+      } else {
+        auto newline = static_cast<const char *>(memchr(data + bound, '\n', size - bound));
+        bound = newline == nullptr ? size : newline - data + 1;
+      }
+      bounds.push_back(bound);
+    }
+    bounds.push_back(size);
+
+    runs->assign(chunks, {});
+    std::vector<char> ok(chunks, 0);
+    auto parse = [&](size_t chunk) {
+      const char *begin = data + bounds[chunk];
+      const char *end = data + bounds[chunk + 1];
+      auto &run = (*runs)[chunk];
+      if (format == FileFormat::BINARY) {
+        ok[chunk] = ParseBinary(begin, end, &run);
+      } else {
+        ok[chunk] = ParseText(begin, end, &run);
+      }
+      std::stable_sort(run.begin(), run.end(), [&comparator](const Entry &lhs, const Entry &rhs) {
+        return comparator(lhs.first, rhs.first) < 0;
+      });
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunks; i++) {
+      workers.emplace_back(parse, i);
+    }
+    parse(0);
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    for (size_t i = 0; i < chunks; i++) {
+      stats->records_ += (*runs)[i].size();
+      if (!ok[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  static bool ParseText(const char *p, const char *end, std::vector<Entry> *run) {
+    int64_t key;
+    int64_t value;
+    Entry entry;
+    while (ParseInt64(&p, end, &key)) {
+      if (!ParseInt64(&p, end, &value)) {
+        return false;
+      }
+      entry.first.SetFromInteger(key);
+      entry.second.SetFromInteger(value);
+      run->push_back(entry);
+    }
+    // Only the end of the chunk may stop the parser.
+    return p == end;
+  }
+
+  static bool ParseBinary(const char *p, const char *end, std::vector<Entry> *run) {
+    run->reserve((end - p) / RECORD_SIZE);
+    int64_t record[2];
+    Entry entry;
+    for (; p < end; p += RECORD_SIZE) {
+      memcpy(record, p, RECORD_SIZE);
+      entry.first.SetFromInteger(le64toh(record[0]));
+      entry.second.SetFromInteger(le64toh(record[1]));
+      run->push_back(entry);
+    }
+    return true;
+  }
+};
+}  // namespace skiplist
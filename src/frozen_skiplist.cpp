@@ -0,0 +1,83 @@
+#include "frozen_skiplist.h"
+
+#include <algorithm>
+
+namespace skiplist {
+template <typename KeyType, typename ValueType, typename KeyComparator>
+FROZEN_SKIPLIST_TYPE::FrozenSkipList(const KeyComparator &comparator, std::vector<KeyType> &&keys,
+                                     std::vector<ValueType> &&values)
+    : comparator_(comparator), keys_(std::move(keys)), values_(std::move(values)) {
+  assert(keys_.size() == values_.size());
+  LOG_INFO("Construct FrozenSkipList with %lu keys", keys_.size());
+  size_t blocks = (keys_.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  index_.resize(blocks + 1);
+  index_block_.resize(blocks + 1);
+  BuildIndex(0, 1);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+size_t FROZEN_SKIPLIST_TYPE::BuildIndex(size_t block, size_t k) {
+  if (k < index_.size()) {
+    block = BuildIndex(block, 2 * k);
+    index_[k] = keys_[block * BLOCK_SIZE];
+    index_block_[k] = block;
+    block = BuildIndex(block + 1, 2 * k + 1);
+  }
+  return block;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+size_t FROZEN_SKIPLIST_TYPE::LowerBlock(const KeyType &key) const {
+  size_t blocks = index_.size() - 1;
+  size_t k = 1;
+  while (k <= blocks) {
+    // The 16 great-great-grandchildren of k are contiguous, fetch them while we compare.
+    __builtin_prefetch(index_.data() + 16 * k);
+    k = 2 * k + (comparator_(index_[k], key) < 0);
+  }
+  // Drop the trailing right turns (and the final left one) to get back to the lower bound.
+  k >>= __builtin_ffsll(~k);
+  return k == 0 ? blocks : index_block_[k];
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool FROZEN_SKIPLIST_TYPE::Lookup(const KeyType &key, std::vector<ValueType> *result) const {
+  LOG_INFO("Lookup: <%ld>", key.ToInteger());
+  if (keys_.empty()) {
+    return false;
+  }
+  size_t block = LowerBlock(key);
+  size_t begin = block * BLOCK_SIZE;
+  if (begin < keys_.size() && comparator_(keys_[begin], key) == 0) {
+    result->push_back(values_[begin]);
+    return true;
+  }
+  if (block == 0) {
+    return false;
+  }
+  // The key can only be in the previous block, whose head is smaller than it.
+  begin -= BLOCK_SIZE;
+  const KeyType *base = keys_.data() + begin;
+  size_t len = std::min(BLOCK_SIZE, keys_.size() - begin);
+  while (len > 1) {
+    size_t half = len / 2;
+    base = comparator_(base[half], key) < 0 ? base + half : base;
+    len -= half;
+  }
+  base += comparator_(*base, key) < 0;
+  size_t pos = base - keys_.data();
+  if (pos < keys_.size() && comparator_(*base, key) == 0) {
+    result->push_back(values_[pos]);
+    return true;
+  }
+  return false;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+size_t FROZEN_SKIPLIST_TYPE::MemoryUsage() const {
+  return keys_.capacity() * sizeof(KeyType) + values_.capacity() * sizeof(ValueType) +
+         index_.capacity() * sizeof(KeyType) + index_block_.capacity() * sizeof(uint32_t);
+}
+
+template class FrozenSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+}  // namespace skiplist
@@ -0,0 +1,80 @@
+/**
+ * FrozenSkipList: the immutable form of a sealed SkipList (see SkipList::Freeze).
+ * Keys and values sit in two sorted arrays. The first key of every block of BLOCK_SIZE keys is copied into an
+ * Eytzinger-ordered index, so a lookup is a branchless descent over a cache-resident index followed by a branchless
+ * binary search inside one block. No forward pointers are kept at all.
+ * */
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "generic_key.h"
+#include "logger.h"
+
+namespace skiplist {
+
+#define FROZEN_SKIPLIST_TYPE FrozenSkipList<KeyType, ValueType, KeyComparator>
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class FrozenSkipList {
+ public:
+  static constexpr size_t BLOCK_SIZE = 16;
+
+  // keys must be sorted by comparator and unique; values[i] belongs to keys[i].
+  FrozenSkipList(const KeyComparator &comparator, std::vector<KeyType> &&keys, std::vector<ValueType> &&values);
+
+  bool Lookup(const KeyType &key, std::vector<ValueType> *result) const;
+
+  size_t Size() const { return keys_.size(); }
+  // Bytes held by the key, value and index arrays.
+  size_t MemoryUsage() const;
+
+  /************** Iterator Unit **********************/
+ private:
+  class Iterator {
+    using KVPAIR = std::pair<const KeyType &, const ValueType &>;
+
+   public:
+    Iterator(const FrozenSkipList *list, size_t pos) : list_(list), pos_(pos) {}
+
+    KVPAIR operator*() const {
+      assert(pos_ < list_->Size());
+      return KVPAIR{list_->keys_[pos_], list_->values_[pos_]};
+    }
+
+    Iterator &operator++() {
+      assert(pos_ < list_->Size());
+      pos_++;
+      return *this;
+    }
+    bool operator==(const Iterator &itr) const { return pos_ == itr.pos_; }
+    bool operator!=(const Iterator &itr) const { return pos_ != itr.pos_; }
+    ~Iterator() = default;
+
+   private:
+    const FrozenSkipList *list_;
+    size_t pos_;
+  };
+
+ public:
+  Iterator begin() const { return Iterator{this, 0}; }
+  Iterator end() const { return Iterator{this, keys_.size()}; }
+
+ private:
+  // Position of the first key >= key among the block heads, in [0, block count].
+  size_t LowerBlock(const KeyType &key) const;
+  // Fill index_[k..] with the block heads in Eytzinger (breadth-first) order, returns the next block to place.
+  size_t BuildIndex(size_t block, size_t k);
+
+  KeyComparator comparator_;
+  std::vector<KeyType> keys_;
+  std::vector<ValueType> values_;
+  // 1-based Eytzinger layout over the first key of every block; index_block_[k] is the block index_[k] heads.
+  std::vector<KeyType> index_;
+  std::vector<uint32_t> index_block_;
+};
+
+}  // namespace skiplist
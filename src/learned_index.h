@@ -0,0 +1,130 @@
+/**
+ * PiecewiseLinearModel: maps a sorted array of distinct integer keys to positions with a bounded error, for the
+ * learned index of SkipList (see SkipList::EnableLearnedIndex).
+ * Segments are fitted greedily in one pass (the shrinking cone of FITing-tree/PGM): a segment grows while some slope
+ * keeps every one of its keys within epsilon of its position, and the first key that fits no such slope starts the
+ * next one. Predict then costs a binary search over the segment start keys and one multiply.
+ * A segment holds at most MAX_SEGMENT_LENGTH keys, so when the keys of one segment change, Refit fits just that
+ * segment again in time bounded by its length plus a shift of the segments behind it.
+ * */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace skiplist {
+class PiecewiseLinearModel {
+ public:
+  static constexpr size_t MAX_SEGMENT_LENGTH = 256;
+
+  void Train(const std::vector<int64_t> &keys, size_t epsilon) {
+    Clear();
+    size_ = keys.size();
+    Fit(keys, 0, keys.size(), epsilon, &first_keys_, &first_positions_, &slopes_);
+  }
+
+  // keys is the trained array with the keys of segment replaced by those now at [begin, end). Fit them again, into
+  // any number of segments (none if the range is empty), and move the segments behind along.
+  void Refit(const std::vector<int64_t> &keys, size_t segment, size_t begin, size_t end, size_t epsilon) {
+    size_t old_end = SegmentEnd(segment);
+    std::vector<int64_t> segment_keys;
+    std::vector<size_t> segment_positions;
+    std::vector<double> segment_slopes;
+    Fit(keys, begin, end, epsilon, &segment_keys, &segment_positions, &segment_slopes);
+    for (size_t i = segment + 1; i < first_positions_.size(); i++) {
+      first_positions_[i] = first_positions_[i] - old_end + end;
+    }
+    size_ = size_ - old_end + end;
+    Replace(&first_keys_, segment, segment_keys);
+    Replace(&first_positions_, segment, segment_positions);
+    Replace(&slopes_, segment, segment_slopes);
+  }
+
+  // For a trained key, a position within epsilon of its own; for any other key, within epsilon + 1 of the position
+  // of the first trained key above it.
+  size_t Predict(int64_t key) const {
+    auto segment = std::upper_bound(first_keys_.begin(), first_keys_.end(), key) - first_keys_.begin();
+    if (segment == 0) {
+      return 0;
+    }
+    segment--;
+    double dx = static_cast<double>(static_cast<uint64_t>(key) - static_cast<uint64_t>(first_keys_[segment]));
+    // Keys between two segments are held to the start of the next one.
+    size_t limit = static_cast<size_t>(segment) + 1 < first_positions_.size() ? first_positions_[segment + 1] : size_;
+    double position = first_positions_[segment] + slopes_[segment] * dx;
+    return position >= limit ? limit : static_cast<size_t>(position);
+  }
+
+  size_t Segments() const { return first_keys_.size(); }
+  // The segment Predict uses for key.
+  size_t SegmentOf(int64_t key) const {
+    auto segment = std::upper_bound(first_keys_.begin(), first_keys_.end(), key) - first_keys_.begin();
+    return segment == 0 ? 0 : segment - 1;
+  }
+  int64_t SegmentKey(size_t segment) const { return first_keys_[segment]; }
+  // Positions [SegmentBegin, SegmentEnd) of the trained array belong to segment.
+  size_t SegmentBegin(size_t segment) const { return first_positions_[segment]; }
+  size_t SegmentEnd(size_t segment) const {
+    return segment + 1 < first_positions_.size() ? first_positions_[segment + 1] : size_;
+  }
+  size_t MemoryUsage() const {
+    return first_keys_.capacity() * sizeof(int64_t) + first_positions_.capacity() * sizeof(size_t) +
+           slopes_.capacity() * sizeof(double);
+  }
+  void Clear() {
+    first_keys_.clear();
+    first_positions_.clear();
+    slopes_.clear();
+    size_ = 0;
+  }
+
+ private:
+  // Fit keys[begin, end) greedily and append the segments found.
+  static void Fit(const std::vector<int64_t> &keys, size_t begin, size_t end, size_t epsilon,
+                  std::vector<int64_t> *first_keys, std::vector<size_t> *first_positions, std::vector<double> *slopes) {
+    double lo = 0;
+    double hi = std::numeric_limits<double>::infinity();
+    for (size_t i = begin; i < end; i++) {
+      if (i != begin) {
+        // Keys only grow, so the unsigned difference is exact even across the sign boundary.
+        double dx = static_cast<double>(static_cast<uint64_t>(keys[i]) - static_cast<uint64_t>(first_keys->back()));
+        double dy = static_cast<double>(i - first_positions->back());
+        double new_lo = std::max(lo, (dy - epsilon) / dx);
+        double new_hi = std::min(hi, (dy + epsilon) / dx);
+        if (new_lo <= new_hi && i - first_positions->back() < MAX_SEGMENT_LENGTH) {
+          lo = new_lo;
+          hi = new_hi;
+          continue;
+        }
+        slopes->push_back(SlopeOf(lo, hi));
+      }
+      first_keys->push_back(keys[i]);
+      first_positions->push_back(i);
+      lo = 0;
+      hi = std::numeric_limits<double>::infinity();
+    }
+    if (begin != end) {
+      slopes->push_back(SlopeOf(lo, hi));
+    }
+  }
+
+  template <typename T>
+  static void Replace(std::vector<T> *values, size_t index, const std::vector<T> &with) {
+    values->erase(values->begin() + index);
+    values->insert(values->begin() + index, with.begin(), with.end());
+  }
+
+  // Any slope in [lo, hi] keeps the error bound; a lone key has no upper bound.
+  static double SlopeOf(double lo, double hi) {
+    return hi == std::numeric_limits<double>::infinity() ? 0 : (lo + hi) / 2;
+  }
+
+  // Start key and start position of every segment; the keys are searched on every Predict, so they sit apart.
+  std::vector<int64_t> first_keys_;
+  std::vector<size_t> first_positions_;
+  std::vector<double> slopes_;
+  size_t size_{0};
+};
+}  // namespace skiplist
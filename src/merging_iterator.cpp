@@ -0,0 +1,77 @@
+#include "merging_iterator.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace skiplist {
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void MERGING_ITERATOR_TYPE::AddSource(std::unique_ptr<SortedSource<KeyType, ValueType>> source) {
+  sources_.push_back(std::move(source));
+  heap_.clear();
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void MERGING_ITERATOR_TYPE::AddList(SkipList<KeyType, ValueType, KeyComparator> *list) {
+  AddSource(std::unique_ptr<SortedSource<KeyType, ValueType>>(
+      new SkipListSource<KeyType, ValueType, KeyComparator>(list)));
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void MERGING_ITERATOR_TYPE::AddRun(const SortedRun<KeyType, ValueType, KeyComparator> *run) {
+  AddSource(std::unique_ptr<SortedSource<KeyType, ValueType>>(
+      new SortedRunSource<KeyType, ValueType, KeyComparator>(run)));
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool MERGING_ITERATOR_TYPE::Below(size_t a, size_t b) const {
+  int cmp = comparator_(sources_[a]->Key(), sources_[b]->Key());
+  return cmp > 0 || (cmp == 0 && a > b);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void MERGING_ITERATOR_TYPE::BuildHeap() {
+  heap_.clear();
+  for (size_t i = 0; i < sources_.size(); i++) {
+    if (sources_[i]->Valid()) {
+      heap_.push_back(i);
+    }
+  }
+  std::make_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b) { return Below(a, b); });
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void MERGING_ITERATOR_TYPE::SeekToFirst() {
+  for (auto &source : sources_) {
+    source->SeekToFirst();
+  }
+  BuildHeap();
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void MERGING_ITERATOR_TYPE::Seek(const KeyType &key) {
+  for (auto &source : sources_) {
+    source->Seek(key);
+  }
+  BuildHeap();
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void MERGING_ITERATOR_TYPE::Next() {
+  assert(Valid());
+  auto below = [this](size_t a, size_t b) { return Below(a, b); };
+  // Step past the current key in every source that holds it; the later ones were shadowed.
+  KeyType key = Key();
+  do {
+    std::pop_heap(heap_.begin(), heap_.end(), below);
+    size_t top = heap_.back();
+    sources_[top]->Next();
+    if (sources_[top]->Valid()) {
+      std::push_heap(heap_.begin(), heap_.end(), below);
+    } else {
+      heap_.pop_back();
+    }
+  } while (Valid() && comparator_(Key(), key) == 0);
+}
+
+template class MergingIterator<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+}  // namespace skiplist
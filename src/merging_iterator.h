@@ -0,0 +1,98 @@
+/**
+ * MergingIterator: one ordered view over several SkipLists and SortedRuns.
+ * Every source is wrapped in a SortedSource cursor, and the cursors are k-way merged through a binary min-heap, so a
+ * step costs O(log k) comparisons. Sources added first take precedence: when several of them hold the same key, only
+ * the entry of the earliest one is shown, so add the live memtable first and the oldest run last. Removals are not
+ * recorded anywhere, so a key removed from a newer source still shows through from an older one.
+ * Like the SkipList iterator, the cursor takes no latch: the lists must not be written while it is in use.
+ * */
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "generic_key.h"
+#include "skiplist.h"
+#include "sorted_run.h"
+
+namespace skiplist {
+
+#define MERGING_ITERATOR_TYPE MergingIterator<KeyType, ValueType, KeyComparator>
+
+// Cursor interface shared by everything the MergingIterator can merge.
+template <typename KeyType, typename ValueType>
+class SortedSource {
+ public:
+  virtual ~SortedSource() = default;
+  virtual bool Valid() const = 0;
+  virtual void SeekToFirst() = 0;
+  // Position at the first key >= key.
+  virtual void Seek(const KeyType &key) = 0;
+  virtual void Next() = 0;
+  virtual const KeyType &Key() const = 0;
+  virtual const ValueType &Value() const = 0;
+};
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class SkipListSource : public SortedSource<KeyType, ValueType> {
+ public:
+  explicit SkipListSource(SkipList<KeyType, ValueType, KeyComparator> *list) : list_(list), iter_(list->end()) {}
+
+  bool Valid() const override { return iter_ != list_->end(); }
+  void SeekToFirst() override { iter_ = list_->begin(); }
+  void Seek(const KeyType &key) override { iter_ = list_->LowerBound(key); }
+  void Next() override { ++iter_; }
+  const KeyType &Key() const override { return (*iter_).first; }
+  const ValueType &Value() const override { return (*iter_).second; }
+
+ private:
+  SkipList<KeyType, ValueType, KeyComparator> *list_;
+  decltype(std::declval<SkipList<KeyType, ValueType, KeyComparator> &>().begin()) iter_;
+};
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class SortedRunSource : public SortedSource<KeyType, ValueType> {
+ public:
+  explicit SortedRunSource(const SortedRun<KeyType, ValueType, KeyComparator> *run) : iter_(run->NewIterator()) {}
+
+  bool Valid() const override { return iter_.Valid(); }
+  void SeekToFirst() override { iter_.SeekToFirst(); }
+  void Seek(const KeyType &key) override { iter_.Seek(key); }
+  void Next() override { iter_.Next(); }
+  const KeyType &Key() const override { return iter_.Key(); }
+  const ValueType &Value() const override { return iter_.Value(); }
+
+ private:
+  typename SortedRun<KeyType, ValueType, KeyComparator>::Iterator iter_;
+};
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class MergingIterator {
+ public:
+  explicit MergingIterator(const KeyComparator &comparator) : comparator_(comparator) {}
+
+  void AddSource(std::unique_ptr<SortedSource<KeyType, ValueType>> source);
+  void AddList(SkipList<KeyType, ValueType, KeyComparator> *list);
+  void AddRun(const SortedRun<KeyType, ValueType, KeyComparator> *run);
+
+  bool Valid() const { return !heap_.empty(); }
+  void SeekToFirst();
+  // Position at the first key >= key.
+  void Seek(const KeyType &key);
+  void Next();
+  const KeyType &Key() const { return sources_[heap_.front()]->Key(); }
+  const ValueType &Value() const { return sources_[heap_.front()]->Value(); }
+
+ private:
+  // Heap order: the smallest key on top, and among equal keys the earliest source.
+  bool Below(size_t a, size_t b) const;
+  // Rebuild heap_ from every source that is still valid.
+  void BuildHeap();
+
+  KeyComparator comparator_;
+  std::vector<std::unique_ptr<SortedSource<KeyType, ValueType>>> sources_;
+  std::vector<size_t> heap_;  // indexes into sources_
+};
+
+}  // namespace skiplist
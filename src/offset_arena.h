@@ -0,0 +1,174 @@
+/**
+ * OffsetArena: one contiguous, growable mapping whose allocations are named by 32-bit offsets instead of pointers.
+ * Offsets count GRANULE-byte units from the start of the mapping, so 32 bits reach 16GB. The mapping starts with a
+ * small header (allocation mark and one root offset for the client), so 0 is never handed out and stands for null.
+ * Growing may move the whole mapping (mremap), which leaves every offset valid but invalidates any pointer obtained
+ * from At(): resolve offsets again after an Allocate.
+ * An arena opened on a file maps it shared, so whatever the client builds in it is there again on the next Open.
+ * Persist() orders the writes: with sync, it returns once the range is on disk (msync); without, it only keeps the
+ * compiler from reordering, which is enough to survive the process dying but not the machine. The file is flock()ed
+ * while open.
+ * */
+#pragma once
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace skiplist {
+class OffsetArena {
+ public:
+  static constexpr size_t GRANULE = 4;
+  static constexpr size_t DEFAULT_CAPACITY = 1 << 20;
+  static constexpr size_t MAX_CAPACITY = (size_t{1} << 32) * GRANULE;
+  static constexpr uint64_t MAGIC = 0x6f66667365746172;  // "offsetar"
+
+  explicit OffsetArena(size_t capacity = DEFAULT_CAPACITY) : capacity_(RoundUp(capacity, getpagesize())) {
+    void *mem = mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(mem != MAP_FAILED);
+    base_ = static_cast<char *>(mem);
+    InitHeader();
+  }
+  OffsetArena(const OffsetArena &) = delete;
+  OffsetArena &operator=(const OffsetArena &) = delete;
+  ~OffsetArena() {
+    if (fd_ >= 0) {
+      if (sync_) {
+        msync(base_, capacity_, MS_SYNC);
+      }
+      close(fd_);
+    }
+    munmap(base_, capacity_);
+  }
+
+  // Map file_name, creating it with `capacity` bytes if it does not exist. nullptr if the file cannot be mapped, is
+  // open elsewhere, or holds no arena.
+  static std::unique_ptr<OffsetArena> Open(const std::string &file_name, bool sync = true,
+                                           size_t capacity = DEFAULT_CAPACITY) {
+    int fd = open(file_name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat st;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &st) != 0) {
+      close(fd);
+      return nullptr;
+    }
+    bool fresh = st.st_size == 0;
+    size_t size = fresh ? RoundUp(capacity, getpagesize()) : static_cast<size_t>(st.st_size);
+    if ((fresh && ftruncate(fd, size) != 0) || size < sizeof(Header) || size > MAX_CAPACITY) {
+      close(fd);
+      return nullptr;
+    }
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+      close(fd);
+      return nullptr;
+    }
+    std::unique_ptr<OffsetArena> arena(new OffsetArena(static_cast<char *>(mem), size, fd, sync));
+    if (fresh) {
+      arena->InitHeader();
+      arena->PersistHeader();
+    } else if (arena->GetHeader()->magic_ != MAGIC || arena->GetHeader()->used_ > size) {
+      return nullptr;
+    }
+    return arena;
+  }
+
+  // Offset of `bytes` fresh bytes, aligned to GRANULE; 0 once MAX_CAPACITY is exhausted. The new allocation mark
+  // is not persisted here.
+  uint32_t Allocate(size_t bytes) {
+    bytes = RoundUp(bytes, GRANULE);
+    size_t used = GetHeader()->used_;
+    if (used + bytes > capacity_ && !Grow(used + bytes)) {
+      return 0;
+    }
+    GetHeader()->used_ = used + bytes;
+    return static_cast<uint32_t>(used / GRANULE);
+  }
+
+  template <typename T>
+  T *At(uint32_t offset) const {
+    return reinterpret_cast<T *>(base_ + static_cast<size_t>(offset) * GRANULE);
+  }
+
+  // One offset kept in the header for the client to find its data again after Open.
+  uint32_t Root() const { return GetHeader()->root_; }
+  void SetRoot(uint32_t root) { GetHeader()->root_ = root; }
+
+  // Write [offset, offset + bytes) back before any later write; see the top of the file.
+  void Persist(uint32_t offset, size_t bytes) {
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    if (fd_ < 0 || !sync_) {
+      return;
+    }
+    size_t page = getpagesize();
+    size_t begin = static_cast<size_t>(offset) * GRANULE;
+    size_t aligned = begin / page * page;
+    msync(base_ + aligned, begin + bytes - aligned, MS_SYNC);
+  }
+  // The allocation mark and the root.
+  void PersistHeader() { Persist(0, sizeof(Header)); }
+
+  // Forget every allocation but keep the mapping.
+  void Reset() { GetHeader()->used_ = RoundUp(sizeof(Header), GRANULE); }
+
+  // Bytes handed out so far (the header included), and bytes mapped.
+  size_t MemoryUsage() const { return GetHeader()->used_; }
+  size_t Capacity() const { return capacity_; }
+
+ private:
+  struct Header {
+    uint64_t magic_;
+    uint64_t used_;  // bytes handed out, header included
+    uint32_t root_;
+  };
+
+  OffsetArena(char *base, size_t capacity, int fd, bool sync)
+      : base_(base), capacity_(capacity), fd_(fd), sync_(sync) {}
+
+  static size_t RoundUp(size_t bytes, size_t align) { return (bytes + align - 1) & ~(align - 1); }
+
+  Header *GetHeader() const { return reinterpret_cast<Header *>(base_); }
+  void InitHeader() {
+    GetHeader()->magic_ = MAGIC;
+    GetHeader()->used_ = RoundUp(sizeof(Header), GRANULE);
+    GetHeader()->root_ = 0;
+  }
+
+  // Double the mapping until it holds `bytes`; the kernel moves the pages instead of copying them.
+  bool Grow(size_t bytes) {
+    if (bytes > MAX_CAPACITY) {
+      return false;
+    }
+    size_t capacity = capacity_;
+    while (capacity < bytes) {
+      capacity = capacity * 2 > MAX_CAPACITY ? MAX_CAPACITY : capacity * 2;
+    }
+    if (fd_ >= 0 && ftruncate(fd_, capacity) != 0) {
+      return false;
+    }
+    void *mem = mremap(base_, capacity_, capacity, MREMAP_MAYMOVE);
+    if (mem == MAP_FAILED) {
+      return false;
+    }
+    base_ = static_cast<char *>(mem);
+    capacity_ = capacity;
+    return true;
+  }
+
+  char *base_;
+  size_t capacity_;
+  int fd_{-1};  // backing file, -1 for an anonymous arena
+  bool sync_{false};
+};
+}  // namespace skiplist
@@ -0,0 +1,247 @@
+#include "prefix_skiplist.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace skiplist {
+template <typename KeyType, typename ValueType, typename KeyComparator>
+PREFIX_SKIPLIST_TYPE::PrefixSkipList(const KeyComparator &comparator, size_t max_height, size_t branching, size_t rnd)
+    : comparator_(comparator),
+      max_height_(max_height),
+      branching_(branching),
+      rnd_(rnd),
+      arena_(new Arena()),
+      free_nodes_(PrefixNode::AllocSize(max_height, sizeof(KeyType)) + 1, nullptr),
+      update_(max_height) {
+  LOG_INFO("Construct PrefixSkipList with max_height: %lu and random seed: %lu", max_height, rnd);
+  assert(max_height < 256);
+  srand(rnd_);
+  KeyType zero;
+  memset(static_cast<void *>(&zero), 0, sizeof(KeyType));
+  head_ = CreateNode(max_height, zero, ValueType{}, nullptr);
+  key_bytes_ = 0;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+typename PREFIX_SKIPLIST_TYPE::PrefixNode *PREFIX_SKIPLIST_TYPE::Find(const KeyType &key, PrefixNode **path,
+                                                                      KeyType *pred_key, KeyType *found_key) {
+  // Towers hold full keys, so the upper levels compare in place of a decode.
+  auto cur = head_;
+  KeyType cur_key;
+  memset(static_cast<void *>(&cur_key), 0, sizeof(KeyType));
+  KeyType next_key;
+  for (int level = max_height_ - 1; level >= 1; level--) {
+    auto p = cur->Forward()[level];
+    while (p != nullptr) {
+      memcpy(static_cast<void *>(&next_key), p->Bytes(), sizeof(KeyType));
+      if (comparator_(next_key, key) >= 0) {
+        break;
+      }
+      cur = p;
+      cur_key = next_key;
+      p = p->Forward()[level];
+    }
+    if (path != nullptr) {
+      path[level] = cur;
+    }
+  }
+  // Level 0 from the last restart point: decode one node after the other.
+  auto p = cur->Forward()[0];
+  while (p != nullptr) {
+    next_key = cur_key;
+    p->Decode(&next_key);
+    if (comparator_(next_key, key) >= 0) {
+      break;
+    }
+    cur = p;
+    cur_key = next_key;
+    p = p->Forward()[0];
+  }
+  if (path != nullptr) {
+    path[0] = cur;
+  }
+  if (pred_key != nullptr) {
+    *pred_key = cur_key;
+  }
+  if (found_key != nullptr && p != nullptr) {
+    *found_key = next_key;
+  }
+  return p;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool PREFIX_SKIPLIST_TYPE::Lookup(const KeyType &key, std::vector<ValueType> *result) {
+  rwlatch_.RLock();
+  LOG_INFO("Lookup: <%ld>", key.ToInteger());
+  KeyType found_key;
+  auto node = Find(key, nullptr, nullptr, &found_key);
+  if (node == nullptr || comparator_(found_key, key) != 0) {
+    rwlatch_.RUnLock();
+    return false;
+  }
+  result->push_back(node->value_);
+  rwlatch_.RUnLock();
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool PREFIX_SKIPLIST_TYPE::Insert(const KeyType &key, const ValueType &value) {
+  rwlatch_.WLock();
+  KeyType pred_key;
+  KeyType next_key;
+  auto next = Find(key, update_.data(), &pred_key, &next_key);
+  if (next != nullptr && comparator_(next_key, key) == 0) {
+    LOG_WARN("The key: %lu has already existed!", key.ToInteger());
+    rwlatch_.WUnLock();
+    return false;
+  }
+  size_t height = RandomHeight();
+  auto node = CreateNode(height, key, value, height > 1 ? nullptr : &pred_key);
+  for (size_t level = 0; level < height; level++) {
+    node->Forward()[level] = update_[level]->Forward()[level];
+    update_[level]->Forward()[level] = node;
+  }
+  // The successor was encoded against pred_key, which no longer comes right before it.
+  Rebase(node, next, next_key, key);
+  size_++;
+  rwlatch_.WUnLock();
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool PREFIX_SKIPLIST_TYPE::Remove(const KeyType &key) {
+  rwlatch_.WLock();
+  LOG_INFO("Remove: %ld", key.ToInteger());
+  KeyType pred_key;
+  KeyType node_key;
+  auto node = Find(key, update_.data(), &pred_key, &node_key);
+  if (node == nullptr || comparator_(node_key, key) != 0) {
+    LOG_WARN("The key is not exists.");
+    rwlatch_.WUnLock();
+    return false;
+  }
+  for (size_t level = 0; level < node->height_; level++) {
+    update_[level]->Forward()[level] = node->Forward()[level];
+  }
+  auto next = node->Forward()[0];
+  if (next != nullptr) {
+    KeyType next_key = node_key;
+    next->Decode(&next_key);
+    Rebase(update_[0], next, next_key, pred_key);
+  }
+  FreeNode(node);
+  size_--;
+  rwlatch_.WUnLock();
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void PREFIX_SKIPLIST_TYPE::Rebase(PrefixNode *prev, PrefixNode *node, const KeyType &node_key, const KeyType &base) {
+  if (node == nullptr || node->height_ > 1) {
+    return;
+  }
+  size_t prefix;
+  size_t suffix;
+  Delta(node_key, base, &prefix, &suffix);
+  if (sizeof(KeyType) - prefix - suffix == node->StoredBytes()) {
+    // Same size: rewrite the node in place.
+    node->shared_prefix_ = prefix;
+    node->shared_suffix_ = suffix;
+    memcpy(node->Bytes(), reinterpret_cast<const char *>(&node_key) + prefix, node->StoredBytes());
+    return;
+  }
+  auto replacement = CreateNode(1, node_key, node->value_, &base);
+  // A level-0-only node has no other incoming link than prev's.
+  replacement->Forward()[0] = node->Forward()[0];
+  prev->Forward()[0] = replacement;
+  FreeNode(node);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void PREFIX_SKIPLIST_TYPE::Delta(const KeyType &key, const KeyType &base, size_t *prefix, size_t *suffix) {
+  const char *bytes = reinterpret_cast<const char *>(&key);
+  const char *base_bytes = reinterpret_cast<const char *>(&base);
+  *prefix = 0;
+  while (*prefix < sizeof(KeyType) && bytes[*prefix] == base_bytes[*prefix]) {
+    (*prefix)++;
+  }
+  *suffix = 0;
+  while (*suffix < sizeof(KeyType) - *prefix &&
+         bytes[sizeof(KeyType) - 1 - *suffix] == base_bytes[sizeof(KeyType) - 1 - *suffix]) {
+    (*suffix)++;
+  }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+typename PREFIX_SKIPLIST_TYPE::PrefixNode *PREFIX_SKIPLIST_TYPE::CreateNode(size_t height, const KeyType &key,
+                                                                            const ValueType &value,
+                                                                            const KeyType *base) {
+  size_t prefix = 0;
+  size_t suffix = 0;
+  if (base != nullptr) {
+    Delta(key, *base, &prefix, &suffix);
+  }
+  size_t stored = sizeof(KeyType) - prefix - suffix;
+  size_t alloc_size = PrefixNode::AllocSize(height, stored);
+  void *mem = free_nodes_[alloc_size];
+  if (mem != nullptr) {
+    free_nodes_[alloc_size] = free_nodes_[alloc_size]->Forward()[0];
+  } else {
+    mem = arena_->Allocate(alloc_size, alignof(PrefixNode));
+    memory_usage_ += alloc_size;
+  }
+  auto node = new (mem) PrefixNode{value, static_cast<uint8_t>(height), static_cast<uint8_t>(prefix),
+                                   static_cast<uint8_t>(suffix)};
+  for (size_t level = 0; level < height; level++) {
+    node->Forward()[level] = nullptr;
+  }
+  memcpy(node->Bytes(), reinterpret_cast<const char *>(&key) + prefix, stored);
+  key_bytes_ += stored;
+  return node;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void PREFIX_SKIPLIST_TYPE::FreeNode(PrefixNode *node) {
+  size_t alloc_size = PrefixNode::AllocSize(node->height_, node->StoredBytes());
+  key_bytes_ -= node->StoredBytes();
+  node->~PrefixNode();
+  // The memory stays in the arena, chained through the slot of the first link.
+  node->Forward()[0] = free_nodes_[alloc_size];
+  free_nodes_[alloc_size] = node;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+size_t PREFIX_SKIPLIST_TYPE::RandomHeight() {
+  // Increase height with probablility 1 in kBranching
+  size_t height = 1;
+  while (height < max_height_ && (size_t)rand() < (RAND_MAX / branching_)) {
+    height += 1;
+  }
+  return height;
+}
+
+////////////////// Iterator /////////////////
+template <typename KeyType, typename ValueType, typename KeyComparator>
+typename PREFIX_SKIPLIST_TYPE::Iterator PREFIX_SKIPLIST_TYPE::begin() {
+  return Iterator{head_->Forward()[0]};
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+typename PREFIX_SKIPLIST_TYPE::Iterator PREFIX_SKIPLIST_TYPE::end() {
+  return Iterator{nullptr};
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+PREFIX_SKIPLIST_TYPE::~PrefixSkipList() {
+  // Nodes live in arena_; only non-trivial values have anything left to run.
+  if (!std::is_trivially_destructible<ValueType>::value) {
+    for (auto node = head_; node != nullptr; node = node->Forward()[0]) {
+      node->value_.~ValueType();
+    }
+  }
+}
+
+template class PrefixSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+template class PrefixSkipList<GenericKey<32>, GenericValue<8>, GenericComparator<32>>;
+template class PrefixSkipList<GenericKey<64>, GenericValue<8>, GenericComparator<64>>;
+}  // namespace skiplist
@@ -0,0 +1,136 @@
+/**
+ * PrefixSkipList: a skiplist whose level-0-only nodes store their key delta-encoded against the key before them.
+ * Such a node keeps the length of the prefix and of the suffix its key shares with the predecessor's, plus the bytes
+ * in between. Zero-padded integers share their tail, string-like keys their head, so a 32 or 64 byte key usually
+ * shrinks to a few bytes. Tower nodes (height >= 2) keep the full key and serve as restart points: a search descends
+ * the towers on full keys and then decodes the short level-0 run behind the last one, branching - 1 nodes on average.
+ * A larger branching thus trades longer runs for fewer full keys.
+ * KeyType must be trivially copyable and shorter than 256 bytes. The list head acts as an all-zero key.
+ * */
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "generic_key.h"
+#include "logger.h"
+#include "rwlatch.h"
+
+namespace skiplist {
+
+#define PREFIX_SKIPLIST_TYPE PrefixSkipList<KeyType, ValueType, KeyComparator>
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class PrefixSkipList {
+  static_assert(std::is_trivially_copyable<KeyType>::value, "keys are encoded byte by byte");
+  static_assert(sizeof(KeyType) < 256, "key lengths are stored in one byte");
+
+ public:
+  explicit PrefixSkipList(const KeyComparator &comparator, size_t max_height = 5, size_t branching = 4,
+                          size_t rnd = 0xdeadbeef);
+
+  bool Insert(const KeyType &key, const ValueType &value);
+  bool Remove(const KeyType &key);
+  bool Lookup(const KeyType &key, std::vector<ValueType> *result);
+
+  size_t Size() { return size_; }
+  // Bytes carved from the arena for nodes. A removed or re-encoded node stays counted until its slot is reused.
+  size_t ApproximateMemoryUsage() { return memory_usage_; }
+  // Key bytes actually stored, to compare with sizeof(KeyType) * Size().
+  size_t KeyBytes() { return key_bytes_; }
+
+  ~PrefixSkipList();
+
+ private:
+  // Nodes are carved from the arena with their forward pointers and then their stored key bytes right behind them.
+  struct alignas(alignof(void *)) PrefixNode {
+    ValueType value_;
+    uint8_t height_;
+    uint8_t shared_prefix_;  // leading bytes taken from the predecessor's key, 0 for a full key
+    uint8_t shared_suffix_;  // trailing bytes taken from the predecessor's key, 0 for a full key
+
+    PrefixNode **Forward() { return reinterpret_cast<PrefixNode **>(this + 1); }
+    char *Bytes() { return reinterpret_cast<char *>(Forward() + height_); }
+    size_t StoredBytes() const { return sizeof(KeyType) - shared_prefix_ - shared_suffix_; }
+    // Turn the predecessor's key into this node's.
+    void Decode(KeyType *key) { memcpy(reinterpret_cast<char *>(key) + shared_prefix_, Bytes(), StoredBytes()); }
+
+    static size_t AllocSize(size_t height, size_t stored) {
+      return sizeof(PrefixNode) + height * sizeof(PrefixNode *) + stored;
+    }
+  };
+
+  size_t RandomHeight();
+  // Lengths of the leading and trailing bytes key shares with base.
+  static void Delta(const KeyType &key, const KeyType &base, size_t *prefix, size_t *suffix);
+  // Node of the given height holding key, delta-encoded against base, or in full without one.
+  PrefixNode *CreateNode(size_t height, const KeyType &key, const ValueType &value, const KeyType *base);
+  void FreeNode(PrefixNode *node);
+  // First node >= key, nullptr if none. Fills path (if given) with the predecessor at every level, and pred_key /
+  // found_key (if given) with the decoded keys of the level-0 predecessor and of the returned node.
+  PrefixNode *Find(const KeyType &key, PrefixNode **path, KeyType *pred_key, KeyType *found_key);
+  // Re-encode node, a successor of prev whose key has become base, against base.
+  void Rebase(PrefixNode *prev, PrefixNode *node, const KeyType &node_key, const KeyType &base);
+
+  /************** Iterator Unit **********************/
+ private:
+  class Iterator {
+    using KVPAIR = std::pair<const KeyType &, ValueType &>;
+
+   public:
+    explicit Iterator(PrefixNode *node) : cur(node) {
+      memset(static_cast<void *>(&key), 0, sizeof(KeyType));
+      if (cur != nullptr) {
+        cur->Decode(&key);
+      }
+    }
+
+    KVPAIR operator*() const {
+      assert(cur != nullptr);
+      return KVPAIR{key, cur->value_};
+    }
+
+    Iterator &operator++() {
+      assert(cur != nullptr);
+      cur = cur->Forward()[0];
+      if (cur != nullptr) {
+        cur->Decode(&key);
+      }
+      return *this;
+    }
+    bool operator==(const Iterator &itr) const { return cur == itr.cur; }
+    bool operator!=(const Iterator &itr) const { return cur != itr.cur; }
+    ~Iterator() = default;
+
+   private:
+    PrefixNode *cur;
+    KeyType key;  // decoded key of cur
+  };
+
+ public:
+  Iterator begin();
+  Iterator end();
+
+ private:
+  KeyComparator comparator_;
+  size_t max_height_;
+  size_t branching_;
+  size_t rnd_;
+  size_t size_{0};
+  size_t memory_usage_{0};
+  size_t key_bytes_{0};
+  ReaderWriterLatch rwlatch_;
+  std::unique_ptr<Arena> arena_;
+  // Freed nodes, one list per allocation size, chained through their first link slot.
+  std::vector<PrefixNode *> free_nodes_;
+  PrefixNode *head_;
+  std::vector<PrefixNode *> update_;  // search path of the current writer
+};
+
+}  // namespace skiplist
@@ -1,64 +1,198 @@
 /**
- *
+ * ReaderWriterLatch: spin-then-park reader-writer latch.
+ * Readers announce themselves in one of READER_SLOTS cache-line padded counters (every thread sticks to its own
+ * slot), so uncontended read locking touches no shared cache line but the writer flag. Waiters spin briefly with
+ * `pause` and then park on a futex. WRITER preference (the default) makes new readers back off as soon as a writer
+ * has announced itself; READER preference lets readers keep entering while a writer waits for them to drain.
  * */
 #pragma once
 
-#include <condition_variable>
-#include <mutex>  //NOLINT
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <thread>  // NOLINT
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
 namespace skiplist {
 class ReaderWriterLatch {
-  using mutex_t = std::mutex;
-  using cond_t = std::condition_variable;
-  static const uint32_t MAX_READERS = 0x3f3f3f3f;
+  static const uint32_t READER_SLOTS = 16;
+  // writer_ states, as in a futex mutex: free, held, held with parked waiters.
+  static const uint32_t FREE = 0;
+  static const uint32_t LOCKED = 1;
+  static const uint32_t CONTENDED = 2;
 
  public:
-  ReaderWriterLatch() = default;
-  ~ReaderWriterLatch() { std::lock_guard<mutex_t> _(mtx_); }  // 析构的时候必须要等所有的线程都处理完
+  enum class Preference { WRITER, READER };
+
+  explicit ReaderWriterLatch(Preference preference = Preference::WRITER) : preference_(preference) {}
+  ReaderWriterLatch(const ReaderWriterLatch &) = delete;
+  ReaderWriterLatch &operator=(const ReaderWriterLatch &) = delete;
+  ~ReaderWriterLatch() = default;
+
   void RLock() {
-    std::unique_lock<std::mutex> mtx(mtx_);
-    while (writer_entered_ || reader_count_ >= MAX_READERS) {
-      reader_.wait(mtx);
+    auto &slot = readers_[Slot()].count_;
+    while (true) {
+      slot.fetch_add(1, std::memory_order_seq_cst);
+      if (writer_.load(std::memory_order_seq_cst) == FREE) {
+        return;
+      }
+      if (preference_ == Preference::READER && !writer_active_.load(std::memory_order_seq_cst)) {
+        // The writer is still waiting for readers to drain, and readers go first.
+        return;
+      }
+      // Back off so the writer can drain, then wait for it to leave.
+      slot.fetch_sub(1, std::memory_order_seq_cst);
+      WakeDrainingWriter();
+      WaitWriterFree();
     }
-    reader_count_ += 1;
+  }
+
+  // RLock without waiting: false, holding nothing, if a writer is in the way.
+  bool TryRLock() {
+    auto &slot = readers_[Slot()].count_;
+    slot.fetch_add(1, std::memory_order_seq_cst);
+    if (writer_.load(std::memory_order_seq_cst) == FREE ||
+        (preference_ == Preference::READER && !writer_active_.load(std::memory_order_seq_cst))) {
+      return true;
+    }
+    slot.fetch_sub(1, std::memory_order_seq_cst);
+    WakeDrainingWriter();
+    return false;
   }
 
   void RUnLock() {
-    std::lock_guard<std::mutex> _(mtx_);
-    reader_count_ -= 1;
-    if (writer_entered_) {
-      if (reader_count_ == 0) {
-        writer_.notify_one();
+    readers_[Slot()].count_.fetch_sub(1, std::memory_order_seq_cst);
+    WakeDrainingWriter();
+  }
+
+  void WLock() {
+    LockWriter();
+    // Then wait for the readers already inside to drain.
+    for (uint32_t spin = 0;; spin++) {
+      writer_active_.store(true, std::memory_order_seq_cst);
+      if (!HasReaders()) {
+        return;
       }
-    } else {
-      if (reader_count_ == MAX_READERS - 1) {
-        reader_.notify_one();
+      // With READER preference, readers keep entering until the writer finds the slots empty.
+      writer_active_.store(false, std::memory_order_seq_cst);
+      if (spin < SpinLimit()) {
+        Pause();
+        continue;
+      }
+      uint32_t seq = drain_seq_.load(std::memory_order_seq_cst);
+      if (HasReaders()) {
+        FutexWait(&drain_seq_, seq);
       }
     }
   }
 
-  void WLock() {
-    std::unique_lock<std::mutex> mtx(mtx_);
-    while (writer_entered_) {
-      reader_.wait(mtx);
+  void WUnLock() {
+    writer_active_.store(false, std::memory_order_seq_cst);
+    if (writer_.exchange(FREE, std::memory_order_seq_cst) == CONTENDED) {
+      FutexWake(&writer_, INT_MAX);
+    }
+  }
+
+ private:
+  struct alignas(64) ReaderSlot {
+    std::atomic<int32_t> count_{0};
+  };
+
+  // Each thread picks a slot once, round robin, and keeps it for every latch.
+  static uint32_t Slot() {
+    static std::atomic<uint32_t> next_slot{0};
+    static thread_local uint32_t slot = next_slot.fetch_add(1, std::memory_order_relaxed) % READER_SLOTS;
+    return slot;
+  }
+
+  // Spinning only pays off when the holder can run at the same time.
+  static uint32_t SpinLimit() {
+    static const uint32_t spin_limit = std::thread::hardware_concurrency() > 1 ? 128 : 0;
+    return spin_limit;
+  }
+
+  // Exclusion among writers: a futex mutex that spins for a while before parking.
+  void LockWriter() {
+    uint32_t state = FREE;
+    if (writer_.compare_exchange_strong(state, LOCKED, std::memory_order_seq_cst)) {
+      return;
+    }
+    for (uint32_t spin = 0; spin < SpinLimit(); spin++) {
+      Pause();
+      state = FREE;
+      if (writer_.compare_exchange_strong(state, LOCKED, std::memory_order_seq_cst)) {
+        return;
+      }
     }
-    writer_entered_ = true;
-    while (reader_count_ > 0) {
-      writer_.wait(mtx);
+    if (state != CONTENDED) {
+      state = writer_.exchange(CONTENDED, std::memory_order_seq_cst);
+    }
+    while (state != FREE) {
+      FutexWait(&writer_, CONTENDED);
+      state = writer_.exchange(CONTENDED, std::memory_order_seq_cst);
     }
   }
 
-  void WUnLock() {
-    std::lock_guard<std::mutex> _(mtx_);
-    writer_entered_ = false;
-    reader_.notify_all();
+  bool HasReaders() const {
+    for (const auto &reader : readers_) {
+      if (reader.count_.load(std::memory_order_seq_cst) != 0) {
+        return true;
+      }
+    }
+    return false;
   }
 
- private:
-  std::mutex mtx_;
-  cond_t reader_;
-  cond_t writer_;
-  bool writer_entered_{false};
-  uint32_t reader_count_{0};
+  void WakeDrainingWriter() {
+    if (writer_.load(std::memory_order_seq_cst) != FREE) {
+      drain_seq_.fetch_add(1, std::memory_order_seq_cst);
+      FutexWake(&drain_seq_, 1);
+    }
+  }
+
+  void WaitWriterFree() {
+    for (uint32_t spin = 0;; spin++) {
+      uint32_t state = writer_.load(std::memory_order_seq_cst);
+      if (state == FREE) {
+        return;
+      }
+      if (spin < SpinLimit()) {
+        Pause();
+        continue;
+      }
+      if (state == CONTENDED ||
+          writer_.compare_exchange_strong(state, CONTENDED, std::memory_order_seq_cst)) {
+        FutexWait(&writer_, CONTENDED);
+      }
+    }
+  }
+
+  static void Pause() {
+#ifdef __x86_64__
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+  }
+
+  static void FutexWait(std::atomic<uint32_t> *addr, uint32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+  }
+
+  static void FutexWake(std::atomic<uint32_t> *addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+  }
+
+  Preference preference_;
+  ReaderSlot readers_[READER_SLOTS];
+  std::atomic<uint32_t> writer_{FREE};
+  std::atomic<uint32_t> drain_seq_{0};  // bumped by readers leaving while a writer drains
+  std::atomic<bool> writer_active_{false};
 };
-}  // namespace skiplist
\ No newline at end of file
+}  // namespace skiplist
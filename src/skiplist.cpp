@@ -1,132 +1,1341 @@
+#include <algorithm>
 #include <cassert>
-#include <fstream>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <thread>
+#include <type_traits>
 
 #include "skiplist.h"
+#include "sorted_run.h"
 
 namespace skiplist {
 SKIPLIST_TEMPLATE_ARGUMENTS
 SKIPLIST_TYPE::SkipList(const KeyComparator &comparator, size_t max_height, size_t branching, size_t rnd)
-    : comparator_(comparator), max_height_(max_height), branching_(branching), rnd_(rnd), size_(0) {
+    : comparator_(comparator),
+      max_height_(max_height),
+      branching_(branching),
+      rnd_(rnd),
+      size_(0),
+      arena_(new Arena()),
+      free_nodes_(max_height, nullptr) {
   LOG_INFO("Construct SkipList with max_height: %lu and random seed: %lu", max_height, rnd);
   srand(rnd_);  // Set random seed for random function
   // Invalid key, value to head node
-  KeyType key{};
-  ValueType value{};
-  head_ = CreateNode(key, value, max_height);
+  head_ = CreateNode(max_height, KeyType{});
+  update_.resize(max_height);
+  rank_.resize(max_height);
+  range_end_.resize(max_height);
+  range_end_rank_.resize(max_height);
 }
 
 SKIPLIST_TEMPLATE_ARGUMENTS
 bool SKIPLIST_TYPE::Lookup(const KeyType &key, std::vector<ValueType> *result) {
+  if (!FilterMayContain(key)) {
+    return false;
+  }
+  // std::lock_guard<std::mutex> _(mtx_);
+  rwlatch_.RLock();
+  LOG_INFO("Lookup: <%ld>", key.ToInteger());
+  auto node = FindEqual(key);
+  if (node == nullptr || Expired(node)) {
+    rwlatch_.RUnLock();
+    if (node == nullptr && filter_.load(std::memory_order_acquire) != nullptr) {
+      filter_false_positives_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return false;
+  }
+  RecordAccess(node);
+  result->push_back(node->value_);
+  rwlatch_.RUnLock();
+  return true;
+}
+
+#ifdef __cpp_impl_coroutine
+SKIPLIST_TEMPLATE_ARGUMENTS
+Task<bool> SKIPLIST_TYPE::LookupAsync(KeyType key, std::vector<ValueType> *result) {
+  if (!FilterMayContain(key)) {
+    co_return false;
+  }
+  // Looked up once: thread_local access is not free in a shared library.
+  InterleavedExecutor *executor = InterleavedExecutor::Current();
+  if (executor == nullptr) {
+    rwlatch_.RLock();
+  }
+  while (executor != nullptr && !rwlatch_.TryRLock()) {
+    if (executor->OthersBlocked()) {
+      // Every task waits for the writer: park the thread on the latch instead of spinning through the queue.
+      rwlatch_.RLock();
+      break;
+    }
+    co_await executor->Block();
+  }
+  // Nodes are fetched once even though the descent meets most of them again on the level below.
+  SkipListNode *node = nullptr;
+  SkipListNode *fetched = nullptr;
+  auto cur = head_;
+  for (int level = max_height_ - 1; level >= 0 && node == nullptr; level--) {
+    auto p = cur->forward_[level];
+    while (p != nullptr) {
+      if (executor != nullptr && p != fetched) {
+        __builtin_prefetch(p);
+        co_await executor->Yield();
+        fetched = p;
+      }
+      int cmp = comparator_(p->key_, key);
+      if (cmp == 0) {
+        node = p;
+        break;
+      }
+      if (cmp > 0) {
+        break;
+      }
+      cur = p;
+      p = p->forward_[level];
+    }
+  }
+  bool found = node != nullptr && !Expired(node);
+  if (found) {
+    RecordAccess(node);
+    result->push_back(node->value_);
+  }
+  rwlatch_.RUnLock();
+  if (node == nullptr && filter_.load(std::memory_order_acquire) != nullptr) {
+    filter_false_positives_.fetch_add(1, std::memory_order_relaxed);
+  }
+  co_return found;
+}
+#endif
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::Insert(const KeyType &key, const ValueType &value) {
+  if (flat_combining_.load(std::memory_order_relaxed)) {
+    return CombineWrite(true, &key, &value);
+  }
+  return Emplace(key, value);
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::Insert(KeyType &&key, ValueType &&value) {
+  if (flat_combining_.load(std::memory_order_relaxed)) {
+    return CombineWrite(true, &key, &value, true);
+  }
+  return Emplace(std::move(key), std::move(value));
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+typename SKIPLIST_TYPE::SkipListNode *SKIPLIST_TYPE::FindEqual(const KeyType &key) {
+  int level = max_height_ - 1;
+  auto cur = head_;
+  if (learned_index_ && !anchor_keys_.empty()) {
+    // Entries before i hold nodes before key. Entry i holds key's own node, one past key, or a patched-in node before
+    // key that is at least as close as the one of entry i - 1.
+    size_t i = AnchorLowerBound(key.ToInteger());
+    cur = i == 0 ? head_ : anchor_nodes_[i - 1];
+    if (i < anchor_nodes_.size() && anchor_nodes_[i] != head_) {
+      int cmp = comparator_(anchor_nodes_[i]->key_, key);
+      if (cmp == 0) {
+        return anchor_nodes_[i];
+      }
+      if (cmp < 0) {
+        cur = anchor_nodes_[i];
+      }
+    }
+    level = static_cast<int>(anchor_level_) - 1;
+  }
+  while (level >= 0) {
+    auto p = cur->forward_[level];
+    while (p && comparator_(p->key_, key) < 0) {
+      p = p->forward_[level];
+      cur = cur->forward_[level];
+    }
+    if (p && comparator_(p->key_, key) == 0) {
+      return p;
+    }
+    level--;
+  }
+  return nullptr;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+typename SKIPLIST_TYPE::SkipListNode *SKIPLIST_TYPE::FindPath(const KeyType &key, bool finger) {
+  // Remember the predecessor of key and its rank at every level.
+  int level = max_height_ - 1;
+  auto cur = head_;
+  size_t rank = 0;
+  while (level >= 0) {
+    if (finger && rank_[level] > rank) {
+      // update_ still holds the path of a key <= this one, resume from it instead of from above.
+      cur = update_[level];
+      rank = rank_[level];
+    }
+    auto p = cur->forward_[level];
+    while (p && comparator_(p->key_, key) < 0) {
+      rank += cur->span_[level];
+      p = p->forward_[level];
+      cur = cur->forward_[level];
+    }
+    update_[level] = cur;
+    rank_[level] = rank;
+    level--;
+  }
+  return cur->forward_[0];
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::FindInsertPosition(const KeyType &key, bool finger) {
+  auto p = FindPath(key, finger);
+  if (p && comparator_(p->key_, key) == 0) {
+    if (Expired(p)) {
+      // An expired entry only waits for the sweeper; the new one takes its place.
+      RemoveLocked(key, true);
+      FindPath(key, true);
+      return true;
+    }
+    LOG_WARN("The key: %lu has already existed!", key.ToInteger());
+    return false;
+  }
+  return true;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::LinkNode(SkipListNode *new_node) {
+  // The filter learns the key before any reader can reach the node.
+  auto filter = filter_.load(std::memory_order_relaxed);
+  if (filter != nullptr) {
+    if (size_ + 1 > 2 * filter_capacity_) {
+      RebuildFilter(2 * (size_ + 1));
+      filter = filter_.load(std::memory_order_relaxed);
+    }
+    filter->Add(&new_node->key_, sizeof(KeyType));
+  }
+  LOG_INFO("ThreadID: %lu, Insert: <%ld> with height: %u", std::hash<std::thread::id>{}(std::this_thread::get_id()),
+           new_node->key_.ToInteger(), new_node->height_);
+  SpliceNode(new_node);
+  size_ += 1;
+  if (change_feed_ != nullptr) {
+    change_feed_->Append(ChangeOp::INSERT, new_node->key_, new_node->value_);
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::SpliceNode(SkipListNode *new_node) {
+  size_t height = new_node->height_;
+  // The new node lands right after update_[0], i.e. at rank rank_[0] + 1.
+  for (int level = 0; level < static_cast<int>(max_height_); level++) {
+    auto prev = update_[level];
+    if (level < static_cast<int>(height)) {
+      new_node->forward_[level] = prev->forward_[level];
+      prev->forward_[level] = new_node;
+      new_node->span_[level] = prev->span_[level] - (rank_[0] - rank_[level]);
+      prev->span_[level] = rank_[0] - rank_[level] + 1;
+    } else {
+      prev->span_[level] += 1;
+    }
+  }
+  new_node->prev_ = update_[0] == head_ ? nullptr : update_[0];
+  if (new_node->forward_[0] != nullptr) {
+    new_node->forward_[0]->prev_ = new_node;
+  } else {
+    tail_ = new_node;
+  }
+  if (learned_index_ && height > anchor_level_) {
+    NoteStaleAnchors(new_node->key_.ToInteger(), new_node->key_.ToInteger(), 1);
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::Remove(const KeyType &key) {
+  if (flat_combining_.load(std::memory_order_relaxed)) {
+    return CombineWrite(false, &key, nullptr);
+  }
   // std::lock_guard<std::mutex> _(mtx_);
+  rwlatch_.WLock();
+  bool removed = RemoveLocked(key, false);
+  rwlatch_.WUnLock();
+  return removed;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::RemoveLocked(const KeyType &key, bool finger) {
+  LOG_INFO("Remove: %ld", key.ToInteger());
+  SkipListNode *delete_node = FindPath(key, finger);
+  if (delete_node == nullptr || comparator_(delete_node->key_, key) != 0) {
+    LOG_WARN("The key is not exists.");
+    return false;
+  }
+  UnlinkNode(delete_node);
+  if (change_feed_ != nullptr) {
+    change_feed_->Append(ChangeOp::REMOVE, delete_node->key_, delete_node->value_);
+  }
+  auto filter = filter_.load(std::memory_order_relaxed);
+  if (filter != nullptr) {
+    filter->Delete(&delete_node->key_, sizeof(KeyType));
+  }
+  FreeNode(delete_node);
+  size_ -= 1;
+  return true;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::UnlinkNode(SkipListNode *delete_node) {
+  for (int level = 0; level < static_cast<int>(max_height_); level++) {
+    auto prev = update_[level];
+    if (prev->forward_[level] == delete_node) {
+      prev->span_[level] += delete_node->span_[level] - 1;
+      prev->forward_[level] = delete_node->forward_[level];
+    } else {
+      prev->span_[level] -= 1;
+    }
+  }
+  if (delete_node->forward_[0] != nullptr) {
+    delete_node->forward_[0]->prev_ = delete_node->prev_;
+  } else {
+    tail_ = delete_node->prev_;
+  }
+  if (learned_index_ && delete_node->height_ > anchor_level_) {
+    RetargetAnchors(delete_node, delete_node, update_[anchor_level_]);
+    NoteStaleAnchors(delete_node->key_.ToInteger(), delete_node->key_.ToInteger(), 1);
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+size_t SKIPLIST_TYPE::RemoveRange(const KeyType &begin, const KeyType &end) {
+  if (comparator_(begin, end) >= 0) {
+    return 0;
+  }
+  rwlatch_.WLock();
+  FindPath(end);
+  std::copy(update_.begin(), update_.end(), range_end_.begin());
+  std::copy(rank_.begin(), rank_.end(), range_end_rank_.begin());
+  FindPath(begin);
+  // The range is every node after update_[0] up to and including range_end_[0].
+  size_t count = range_end_rank_[0] - rank_[0];
+  LOG_INFO("RemoveRange: [%ld, %ld) with %lu keys", begin.ToInteger(), end.ToInteger(), count);
+  if (count == 0) {
+    rwlatch_.WUnLock();
+    return 0;
+  }
+  SkipListNode *first = update_[0]->forward_[0];
+  SkipListNode *last = range_end_[0];
+  for (int level = 0; level < static_cast<int>(max_height_); level++) {
+    // Link past the last node of the range on this level (a no-op where the range has none), and let the span reach
+    // the same successor, now count nodes closer.
+    auto prev = update_[level];
+    prev->span_[level] = range_end_rank_[level] + range_end_[level]->span_[level] - rank_[level] - count;
+    prev->forward_[level] = range_end_[level]->forward_[level];
+  }
+  if (learned_index_) {
+    NoteStaleAnchors(first->key_.ToInteger(), last->key_.ToInteger(),
+                     RetargetAnchors(first, last, update_[anchor_level_]));
+  }
+  RecordChanges(ChangeOp::REMOVE, first, last);
+  auto before = update_[0] == head_ ? nullptr : update_[0];
+  if (last->forward_[0] != nullptr) {
+    last->forward_[0]->prev_ = before;
+  } else {
+    tail_ = before;
+  }
+  last->forward_[0] = detached_;
+  detached_ = first;
+  size_ -= count;
+  rwlatch_.WUnLock();
+  return count;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+std::unique_ptr<SKIPLIST_TYPE> SKIPLIST_TYPE::Split(const KeyType &key) {
+  std::unique_ptr<SkipList> right(new SkipList(comparator_, max_height_, branching_, rnd_));
+  rwlatch_.WLock();
+  FindPath(key);
+  size_t count = size_ - rank_[0];
+  LOG_INFO("Split: %lu keys from <%ld>", count, key.ToInteger());
+  for (int level = 0; level < static_cast<int>(max_height_); level++) {
+    // A node right of the cut keeps its rank minus rank_[0].
+    auto prev = update_[level];
+    right->head_->forward_[level] = prev->forward_[level];
+    right->head_->span_[level] = prev->span_[level] - (rank_[0] - rank_[level]);
+    prev->forward_[level] = nullptr;
+    // Now a null link, which spans to the last node left of the cut.
+    prev->span_[level] = rank_[0] - rank_[level];
+  }
+  if (count != 0) {
+    RecordChanges(ChangeOp::REMOVE, right->head_->forward_[0], tail_);
+    right->head_->forward_[0]->prev_ = nullptr;
+    right->tail_ = tail_;
+    tail_ = update_[0] == head_ ? nullptr : update_[0];
+  }
+  right->size_ = count;
+  size_ -= count;
+  right->BorrowArenas(*this);
+
+  auto moved = std::partition(expiry_heap_.begin(), expiry_heap_.end(),
+                              [this, &key](const std::pair<uint64_t, KeyType> &entry) {
+                                return comparator_(entry.second, key) < 0;
+                              });
+  right->expiry_heap_.assign(moved, expiry_heap_.end());
+  expiry_heap_.erase(moved, expiry_heap_.end());
+  std::make_heap(expiry_heap_.begin(), expiry_heap_.end(), ExpiresLater);
+  std::make_heap(right->expiry_heap_.begin(), right->expiry_heap_.end(), ExpiresLater);
+  auto promoted = std::lower_bound(promoted_.begin(), promoted_.end(), key,
+                                   [this](const KeyType &lhs, const KeyType &rhs) { return comparator_(lhs, rhs) < 0; });
+  right->promoted_.assign(promoted, promoted_.end());
+  promoted_.erase(promoted, promoted_.end());
+  // Node bytes are not tracked per node: the moved ones take their share of the total.
+  size_t memory = count == 0 ? 0 : memory_usage_.load() * count / (size_ + count);
+  memory += sizeof(expiry_heap_[0]) * right->expiry_heap_.size();
+  memory_usage_.fetch_sub(memory);
+  right->memory_usage_.fetch_add(memory);
+  if (learned_index_) {
+    TrainLearnedIndex();
+  }
+  rwlatch_.WUnLock();
+  return right;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::Join(SkipList *other) {
+  if (other == this) {
+    return false;
+  }
+  // Always latch the lower address first, so two opposite Joins cannot deadlock.
+  SkipList *first_latched = std::less<SkipList *>()(this, other) ? this : other;
+  SkipList *second_latched = first_latched == this ? other : this;
+  first_latched->rwlatch_.WLock();
+  second_latched->rwlatch_.WLock();
+  bool append = size_ == 0 || other->size_ == 0 || comparator_(tail_->key_, other->head_->forward_[0]->key_) < 0;
+  if (!append && comparator_(other->tail_->key_, head_->forward_[0]->key_) >= 0) {
+    LOG_WARN("Only lists with disjoint key ranges can be joined");
+    second_latched->rwlatch_.WUnLock();
+    first_latched->rwlatch_.WUnLock();
+    return false;
+  }
+  LOG_INFO("Join %lu keys %s %lu keys", other->size_, append ? "behind" : "in front of", size_);
+  if (other->max_height_ > max_height_) {
+    GrowHeight(other->max_height_);
+  }
+  size_t other_height = other->max_height_;
+  auto other_head = other->head_;
+  if (other->size_ != 0) {
+    RecordChanges(ChangeOp::INSERT, other_head->forward_[0], other->tail_);
+    if (other->change_feed_ != nullptr) {
+      other->change_feed_->Append(ChangeOp::CLEAR, KeyType{}, ValueType{});
+    }
+    // Find the last node on every level of the list that goes in front, and its rank.
+    auto left_head = append ? head_ : other_head;
+    auto cur = left_head;
+    size_t rank = 0;
+    for (int level = (append ? max_height_ : other_height) - 1; level >= 0; level--) {
+      while (cur->forward_[level] != nullptr) {
+        rank += cur->span_[level];
+        cur = cur->forward_[level];
+      }
+      update_[level] = cur;
+      rank_[level] = rank;
+    }
+    auto first = head_->forward_[0];
+    if (append) {
+      // Each last node links to the first node of other on its level, which sits behind our size_ nodes. Where other
+      // has no node, the last node stays the end of its level and just spans further.
+      for (size_t level = 0; level < max_height_; level++) {
+        if (level >= other_height || other_head->forward_[level] == nullptr) {
+          update_[level]->span_[level] += other->size_;
+          continue;
+        }
+        update_[level]->forward_[level] = other_head->forward_[level];
+        update_[level]->span_[level] = size_ - rank_[level] + other_head->span_[level];
+      }
+      other_head->forward_[0]->prev_ = tail_;
+      tail_ = other->tail_;
+    } else {
+      // other's chain goes between head_ and our first nodes; where other has no node, head_ just spans further.
+      for (size_t level = 0; level < max_height_; level++) {
+        if (level >= other_height || update_[level] == other_head) {
+          head_->span_[level] += other->size_;
+          continue;
+        }
+        update_[level]->forward_[level] = head_->forward_[level];
+        update_[level]->span_[level] = other->size_ - rank_[level] + head_->span_[level];
+        head_->forward_[level] = other_head->forward_[level];
+        head_->span_[level] = other_head->span_[level];
+      }
+      first->prev_ = other->tail_;
+    }
+    size_ += other->size_;
+  }
+
+  BorrowArenas(*other);
+  for (size_t level = 0; level < other_height; level++) {
+    other_head->forward_[level] = nullptr;
+    other_head->span_[level] = 0;
+  }
+  other->tail_ = nullptr;
+  other->size_ = 0;
+  for (auto &entry : other->expiry_heap_) {
+    expiry_heap_.push_back(std::move(entry));
+  }
+  std::make_heap(expiry_heap_.begin(), expiry_heap_.end(), ExpiresLater);
+  other->expiry_heap_.clear();
+  std::vector<KeyType> promoted;
+  std::merge(promoted_.begin(), promoted_.end(), other->promoted_.begin(), other->promoted_.end(),
+             std::back_inserter(promoted),
+             [this](const KeyType &lhs, const KeyType &rhs) { return comparator_(lhs, rhs) < 0; });
+  promoted_.swap(promoted);
+  other->promoted_.clear();
+  size_t memory = other->memory_usage_.load();
+  other->ResetMemoryUsage();
+  memory_usage_.fetch_add(memory - other->memory_usage_.load());
+  auto other_filter = other->filter_.load(std::memory_order_relaxed);
+  if (other_filter != nullptr) {
+    other_filter->Clear();
+  }
+  if (filter_.load(std::memory_order_relaxed) != nullptr) {
+    RebuildFilter(std::max(filter_capacity_, size_));
+  }
+  // Both anchor arrays hold nodes that moved, and ours may hold the head that GrowHeight replaced.
+  if (learned_index_) {
+    TrainLearnedIndex();
+  }
+  if (other->learned_index_) {
+    other->TrainLearnedIndex();
+  }
+  second_latched->rwlatch_.WUnLock();
+  first_latched->rwlatch_.WUnLock();
+  return true;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::GrowHeight(size_t max_height) {
+  free_nodes_.resize(max_height, nullptr);
+  auto head = CreateNode(max_height, KeyType{});
+  for (size_t level = 0; level < max_height_; level++) {
+    head->forward_[level] = head_->forward_[level];
+    head->span_[level] = head_->span_[level];
+  }
+  FreeNode(head_);
+  head_ = head;
+  max_height_ = max_height;
+  update_.resize(max_height);
+  rank_.resize(max_height);
+  range_end_.resize(max_height);
+  range_end_rank_.resize(max_height);
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::BorrowArenas(const SkipList &from) {
+  auto borrow = [this](const std::shared_ptr<Arena> &arena) {
+    if (arena != arena_ &&
+        std::find(borrowed_arenas_.begin(), borrowed_arenas_.end(), arena) == borrowed_arenas_.end()) {
+      borrowed_arenas_.push_back(arena);
+    }
+  };
+  borrow(from.arena_);
+  for (auto &arena : from.borrowed_arenas_) {
+    borrow(arena);
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+std::unique_ptr<SKIPLIST_TYPE> SKIPLIST_TYPE::Intersect(SkipList *other) {
+  return Combine(SetOperation::INTERSECT, other);
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+std::unique_ptr<SKIPLIST_TYPE> SKIPLIST_TYPE::Union(SkipList *other) {
+  return Combine(SetOperation::UNION, other);
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+std::unique_ptr<SKIPLIST_TYPE> SKIPLIST_TYPE::Difference(SkipList *other) {
+  return Combine(SetOperation::DIFFERENCE, other);
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+size_t SKIPLIST_TYPE::CountIntersection(SkipList *other) {
+  RLockPair(other);
+  size_t count = 0;
+  auto view = View(SetOperation::INTERSECT, other);
+  for (auto it = view.begin(); it != view.end(); ++it) {
+    count++;
+  }
+  RUnLockPair(other);
+  return count;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+std::unique_ptr<SKIPLIST_TYPE> SKIPLIST_TYPE::Combine(SetOperation op, SkipList *other) {
+  std::unique_ptr<SkipList> result(new SkipList(comparator_, max_height_, branching_, rnd_));
+  RLockPair(other);
+  auto view = View(op, other);
+  for (auto it = view.begin(); it != view.end(); ++it) {
+    // Keys only grow, so every search resumes from the previous path, which ends at the tail.
+    result->FindPath(it.cur->key_, result->size_ != 0);
+    result->LinkNode(result->CreateNode(result->RandomHeight(), it.cur->key_, it.cur->value_));
+  }
+  RUnLockPair(other);
+  return result;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::SetIterator::Advance() {
+  auto less = [this](SkipListNode *lhs_node, SkipListNode *rhs_node) {
+    return this->lhs->comparator_(lhs_node->key_, rhs_node->key_) < 0;
+  };
+  while (true) {
+    // An expired entry is absent on either side: it neither matches, nor masks, nor shows up.
+    while (a != nullptr && Expired(a)) {
+      a = a->forward_[0];
+    }
+    while (b != nullptr && Expired(b)) {
+      b = b->forward_[0];
+    }
+    if (a == nullptr && b == nullptr) {
+      break;
+    }
+    if (b == nullptr || (a != nullptr && less(a, b))) {
+      if (op == SetOperation::INTERSECT) {
+        // Nothing before b can match.
+        a = b == nullptr ? nullptr : lhs->Gallop(a, b->key_, &a_path);
+        continue;
+      }
+      cur = a;
+      a = a->forward_[0];
+      return;
+    }
+    if (a == nullptr || less(b, a)) {
+      if (op == SetOperation::UNION) {
+        cur = b;
+        b = b->forward_[0];
+        return;
+      }
+      // Keys of rhs alone never make it out of an intersection or a difference.
+      b = a == nullptr ? nullptr : lhs->Gallop(b, a->key_, &b_path);
+      continue;
+    }
+    // The same key on both sides.
+    auto match = a;
+    a = a->forward_[0];
+    b = b->forward_[0];
+    if (op != SetOperation::DIFFERENCE) {
+      cur = match;
+      return;
+    }
+  }
+  cur = nullptr;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+typename SKIPLIST_TYPE::SkipListNode *SKIPLIST_TYPE::Gallop(SkipListNode *from, const KeyType &key,
+                                                           std::vector<SkipListNode *> *path) const {
+  if (from == nullptr || comparator_(from->key_, key) >= 0) {
+    return from;
+  }
+  // Up the path while the next node one level higher still falls short of key: the levels below cannot skip further.
+  auto &finger = *path;
+  size_t level = 0;
+  while (level + 1 < finger.size() && finger[level + 1]->forward_[level + 1] != nullptr &&
+         comparator_(finger[level + 1]->forward_[level + 1]->key_, key) < 0) {
+    level++;
+  }
+  // Then down from there as a search from the head would, leaving the path to key behind.
+  auto cur = finger[level];
+  for (int l = static_cast<int>(level); l >= 0; l--) {
+    while (cur->forward_[l] != nullptr && comparator_(cur->forward_[l]->key_, key) < 0) {
+      cur = cur->forward_[l];
+    }
+    finger[l] = cur;
+  }
+  return cur->forward_[0];
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::RLockPair(SkipList *other) {
+  SkipList *first_latched = std::less<SkipList *>()(this, other) ? this : other;
+  SkipList *second_latched = first_latched == this ? other : this;
+  first_latched->rwlatch_.RLock();
+  if (second_latched != first_latched) {
+    second_latched->rwlatch_.RLock();
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::RUnLockPair(SkipList *other) {
+  rwlatch_.RUnLock();
+  if (other != this) {
+    other->rwlatch_.RUnLock();
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::CombineWrite(bool insert, const KeyType *key, const ValueType *value, bool movable) {
+  if (insert) {
+    ThrottleWriter();
+  }
+  WriteRequest request{insert, key, value, movable};
+  request.next_ = pending_.load(std::memory_order_relaxed);
+  while (!pending_.compare_exchange_weak(request.next_, &request, std::memory_order_release,
+                                         std::memory_order_relaxed)) {
+  }
+  while (!request.done_.load(std::memory_order_acquire)) {
+    if (combiner_mtx_.try_lock()) {
+      ApplyPendingWrites();
+      combiner_mtx_.unlock();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  return request.result_;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::ApplyPendingWrites() {
+  WriteRequest *request = pending_.exchange(nullptr, std::memory_order_acquire);
+  if (request == nullptr) {
+    return;
+  }
+  batch_.clear();
+  for (; request != nullptr; request = request->next_) {
+    batch_.push_back(request);
+  }
+  // The publication stack is newest first; a stable sort on the reversed batch keeps arrival order per key.
+  std::reverse(batch_.begin(), batch_.end());
+  std::stable_sort(batch_.begin(), batch_.end(), [this](const WriteRequest *lhs, const WriteRequest *rhs) {
+    return comparator_(*lhs->key_, *rhs->key_) < 0;
+  });
+
+  rwlatch_.WLock();
+  LOG_INFO("Combine %lu writes", batch_.size());
+  bool finger = false;
+  for (auto req : batch_) {
+    if (req->insert_) {
+      req->result_ = !Full() && FindInsertPosition(*req->key_, finger);
+      if (req->result_ && req->movable_) {
+        // The writer handed over rvalues and does not look at them again; only later keys are compared from here on.
+        LinkNode(CreateNode(RandomHeight(), std::move(*const_cast<KeyType *>(req->key_)),
+                            std::move(*const_cast<ValueType *>(req->value_))));
+      } else if (req->result_) {
+        LinkNode(CreateNode(RandomHeight(), *req->key_, *req->value_));
+      }
+    } else {
+      req->result_ = RemoveLocked(*req->key_, finger);
+    }
+    finger = true;
+  }
+  rwlatch_.WUnLock();
+  for (auto req : batch_) {
+    // The request lives on its writer's stack, which may unwind as soon as done_ is set.
+    req->done_.store(true, std::memory_order_release);
+  }
+  SignalFull();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+uint64_t SKIPLIST_TYPE::NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::InsertWithTTL(const KeyType &key, const ValueType &value, std::chrono::milliseconds ttl) {
+  // Never 0, which means no expiry.
+  uint64_t expire_at = std::max<uint64_t>(NowMs() + std::max<int64_t>(ttl.count(), 0), 1);
+  ThrottleWriter();
+  rwlatch_.WLock();
+  if (Full() || !FindInsertPosition(key)) {
+    rwlatch_.WUnLock();
+    SignalFull();
+    return false;
+  }
+  auto node = CreateNode(RandomHeight(), key, value);
+  node->expire_at_ = expire_at;
+  LinkNode(node);
+  expiry_heap_.emplace_back(expire_at, key);
+  std::push_heap(expiry_heap_.begin(), expiry_heap_.end(), ExpiresLater);
+  memory_usage_.fetch_add(sizeof(expiry_heap_[0]), std::memory_order_relaxed);
+  rwlatch_.WUnLock();
+  SignalFull();
+  return true;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+size_t SKIPLIST_TYPE::EvictExpired(size_t max_nodes) {
+  size_t evicted = 0;
+  rwlatch_.WLock();
+  uint64_t now = NowMs();
+  while (evicted < max_nodes && !expiry_heap_.empty() && expiry_heap_.front().first <= now) {
+    std::pop_heap(expiry_heap_.begin(), expiry_heap_.end(), ExpiresLater);
+    auto entry = std::move(expiry_heap_.back());
+    expiry_heap_.pop_back();
+    memory_usage_.fetch_sub(sizeof(entry), std::memory_order_relaxed);
+    auto node = FindEqual(entry.second);
+    if (node != nullptr && node->expire_at_ == entry.first) {
+      RemoveLocked(entry.second, false);
+      evicted++;
+    }
+  }
+  rwlatch_.WUnLock();
+  LOG_INFO("Evict %lu expired entries", evicted);
+  return evicted;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::StartSweeper(std::chrono::milliseconds interval, size_t slice) {
+  StopSweeper();
+  sweeper_stop_ = false;
+  sweeper_ = std::thread([this, interval, slice]() {
+    std::unique_lock<std::mutex> lock(sweeper_mtx_);
+    while (!sweeper_stop_) {
+      lock.unlock();
+      size_t evicted = EvictExpired(slice);
+      lock.lock();
+      if (evicted < slice) {
+        sweeper_cv_.wait_for(lock, interval, [this]() { return sweeper_stop_; });
+      }
+    }
+  });
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::StopSweeper() {
+  if (!sweeper_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(sweeper_mtx_);
+    sweeper_stop_ = true;
+  }
+  sweeper_cv_.notify_all();
+  sweeper_.join();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::SetAccessBias(bool enable, size_t sample_rate) {
+  uint32_t mask = 0;
+  while (mask + 1 < sample_rate && mask < (1U << 31)) {
+    mask = (mask << 1) | 1;
+  }
+  access_sample_mask_.store(mask, std::memory_order_relaxed);
+  access_bias_.store(enable);
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::Rebalance(size_t hot_keys) {
+  // Pick the hottest keys with a min-heap on their counts; the counts only need the read latch.
+  std::vector<std::pair<uint32_t, KeyType>> hot;
+  auto hotter = [](const std::pair<uint32_t, KeyType> &lhs, const std::pair<uint32_t, KeyType> &rhs) {
+    return lhs.first > rhs.first;
+  };
+  rwlatch_.RLock();
+  for (auto p = head_->forward_[0]; p != nullptr && hot_keys != 0; p = p->forward_[0]) {
+    uint32_t hits = p->hits_.load(std::memory_order_relaxed);
+    if (hits == 0) {
+      continue;
+    }
+    p->hits_.fetch_sub(hits - hits / 2, std::memory_order_relaxed);
+    if (hot.size() < hot_keys) {
+      hot.emplace_back(hits, p->key_);
+      std::push_heap(hot.begin(), hot.end(), hotter);
+    } else if (hits > hot.front().first) {
+      std::pop_heap(hot.begin(), hot.end(), hotter);
+      hot.back() = std::make_pair(hits, p->key_);
+      std::push_heap(hot.begin(), hot.end(), hotter);
+    }
+  }
+  rwlatch_.RUnLock();
+  // Hottest first: one key at max_height_, the next branching_ - 1 one level lower, and so on.
+  std::sort_heap(hot.begin(), hot.end(), hotter);
+  std::vector<std::pair<KeyType, size_t>> targets;
+  size_t group = 1;
+  size_t height = max_height_;
+  for (size_t i = 0; i < hot.size(); i++) {
+    if (i + 1 >= group * branching_) {
+      group *= branching_;
+      height = std::max<size_t>(height - 1, 1);
+    }
+    targets.emplace_back(std::move(hot[i].second), height);
+  }
+  auto key_less = [this](const KeyType &lhs, const KeyType &rhs) { return comparator_(lhs, rhs) < 0; };
+  std::sort(targets.begin(), targets.end(),
+            [&key_less](const std::pair<KeyType, size_t> &lhs, const std::pair<KeyType, size_t> &rhs) {
+              return key_less(lhs.first, rhs.first);
+            });
+
+  rwlatch_.WLock();
+  std::vector<KeyType> promoted;
+  for (const auto &target : targets) {
+    auto node = FindEqual(target.first);
+    if (node == nullptr) {
+      continue;
+    }
+    // A key whose random tower is already tall enough is left alone.
+    bool was_promoted = std::binary_search(promoted_.begin(), promoted_.end(), target.first, key_less);
+    if (node->height_ < target.second || was_promoted) {
+      SetHeight(target.first, target.second);
+      promoted.push_back(target.first);
+    }
+  }
+  size_t demoted = 0;
+  for (const auto &key : promoted_) {
+    if (!std::binary_search(promoted.begin(), promoted.end(), key, key_less) && SetHeight(key, RandomHeight())) {
+      demoted++;
+    }
+  }
+  promoted_.swap(promoted);
+  rwlatch_.WUnLock();
+  LOG_INFO("Rebalance: %lu keys promoted, %lu demoted", promoted_.size(), demoted);
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::SetHeight(const KeyType &key, size_t height) {
+  auto node = FindPath(key);
+  if (node == nullptr || comparator_(node->key_, key) != 0) {
+    return false;
+  }
+  if (node->height_ == height) {
+    return true;
+  }
+  // update_ and rank_ stay valid across the unlink: they only describe nodes before this one.
+  UnlinkNode(node);
+  auto replacement = CreateNode(height, std::move(node->key_), std::move(node->value_));
+  replacement->expire_at_ = node->expire_at_;
+  replacement->hits_.store(node->hits_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  FreeNode(node);
+  SpliceNode(replacement);
+  return true;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::StartRebalancer(std::chrono::milliseconds interval, size_t hot_keys) {
+  StopRebalancer();
+  rebalancer_stop_ = false;
+  rebalancer_ = std::thread([this, interval, hot_keys]() {
+    std::unique_lock<std::mutex> lock(rebalancer_mtx_);
+    while (!rebalancer_cv_.wait_for(lock, interval, [this]() { return rebalancer_stop_; })) {
+      lock.unlock();
+      Rebalance(hot_keys);
+      lock.lock();
+    }
+  });
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::StopRebalancer() {
+  if (!rebalancer_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(rebalancer_mtx_);
+    rebalancer_stop_ = true;
+  }
+  rebalancer_cv_.notify_all();
+  rebalancer_.join();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::EnableFilter(size_t expected_keys, size_t cells_per_key) {
+  rwlatch_.WLock();
+  filter_cells_per_key_ = cells_per_key;
+  RebuildFilter(std::max(expected_keys, size_));
+  rwlatch_.WUnLock();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::RebuildFilter(size_t expected_keys) {
+  LOG_INFO("Build filter for %lu keys", expected_keys);
+  // The new filter learns live keys only, so the detached ones have to leave the old one for good.
+  ReclaimDetached(std::numeric_limits<size_t>::max());
+  auto filter = new CountingBloomFilter(expected_keys, filter_cells_per_key_);
+  for (auto p = head_->forward_[0]; p != nullptr; p = p->forward_[0]) {
+    filter->Add(&p->key_, sizeof(KeyType));
+  }
+  filter_capacity_ = expected_keys;
+  memory_usage_.fetch_add(filter->MemoryUsage(), std::memory_order_relaxed);
+  auto old_filter = filter_.exchange(filter, std::memory_order_acq_rel);
+  if (old_filter != nullptr) {
+    retired_filters_.emplace_back(old_filter);
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::FilterMayContain(const KeyType &key) {
+  auto filter = filter_.load(std::memory_order_acquire);
+  if (filter == nullptr || filter->MayContain(&key, sizeof(KeyType))) {
+    return true;
+  }
+  filter_negatives_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+double SKIPLIST_TYPE::FilterFalsePositiveRate() {
+  size_t false_positives = filter_false_positives_.load();
+  size_t negatives = filter_negatives_.load();
+  return false_positives + negatives == 0 ? 0 : static_cast<double>(false_positives) / (false_positives + negatives);
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+double SKIPLIST_TYPE::FilterBitsPerKey() {
   rwlatch_.RLock();
-  LOG_INFO("Lookup: <%ld>", key.ToInteger());
+  auto filter = filter_.load(std::memory_order_acquire);
+  double bits = filter == nullptr ? 0 : 8.0 * filter->MemoryUsage() / std::max<size_t>(size_, 1);
+  rwlatch_.RUnLock();
+  return bits;
+}
 
-  int level = max_height_ - 1;
-  auto cur = head_;
-  while (level >= 0) {
-    auto p = cur->forward_[level];
-    while (p && comparator_(p->key_, key) < 0) {
-      p = p->forward_[level];
-      cur = cur->forward_[level];
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::EnableLearnedIndex(bool enable, size_t anchor_level, size_t epsilon) {
+  rwlatch_.WLock();
+  if (enable && max_height_ < 2) {
+    LOG_WARN("A list of height %lu has no levels above level 0 to stand in for", max_height_);
+    enable = false;
+  }
+  learned_index_ = enable;
+  // Level 0 holds every node, and nothing may be taller than the head.
+  anchor_level_ = std::min(std::max<size_t>(anchor_level, 1), max_height_ - 1);
+  learned_epsilon_ = epsilon;
+  TrainLearnedIndex();
+  rwlatch_.WUnLock();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+size_t SKIPLIST_TYPE::LearnedSegments() {
+  rwlatch_.RLock();
+  size_t segments = model_.Segments();
+  rwlatch_.RUnLock();
+  return segments;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::TrainLearnedIndex() {
+  anchor_keys_.clear();
+  anchor_nodes_.clear();
+  stale_anchors_ = 0;
+  if (learned_index_) {
+    for (auto p = head_->forward_[anchor_level_]; p != nullptr; p = p->forward_[anchor_level_]) {
+      anchor_keys_.push_back(p->key_.ToInteger());
+      anchor_nodes_.push_back(p);
     }
-    if (p && comparator_(p->key_, key) == 0) {
-      result->push_back(p->value_);
-      rwlatch_.RUnLock();
-      return true;
+    model_.Train(anchor_keys_, learned_epsilon_);
+  } else {
+    model_.Clear();
+    anchor_keys_.shrink_to_fit();
+    anchor_nodes_.shrink_to_fit();
+  }
+  stale_segments_.assign(model_.Segments(), 0);
+  LOG_INFO("Train learned index: %lu anchors in %lu segments", anchor_keys_.size(), model_.Segments());
+  AccountLearnedMemory();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::NoteStaleAnchors(int64_t first, int64_t last, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  if (model_.Segments() == 0) {
+    // Nothing to refit: train from scratch once there are a few anchors to train on.
+    stale_anchors_ += count;
+    if (stale_anchors_ > 64) {
+      TrainLearnedIndex();
+    }
+    return;
+  }
+  // Back to front, so refitting a segment leaves the numbers of those still to come alone.
+  size_t first_segment = model_.SegmentOf(first);
+  for (size_t segment = model_.SegmentOf(last) + 1; segment-- > first_segment;) {
+    stale_segments_[segment] += count;
+    if (stale_segments_[segment] > (model_.SegmentEnd(segment) - model_.SegmentBegin(segment)) / 4 + 8) {
+      RefitAnchors(segment);
     }
-    level--;
   }
-  rwlatch_.RUnLock();
-  return false;
 }
 
 SKIPLIST_TEMPLATE_ARGUMENTS
-bool SKIPLIST_TYPE::Insert(const KeyType &key, const ValueType &value) {
-  // std::lock_guard<std::mutex> _(mtx_);
-  rwlatch_.WLock();
-  // firstly, we will lookup the skiplist for the key to be inserted.
-  int level = max_height_ - 1;
-  auto cur = head_;
-  while (level >= 0) {
-    auto p = cur->forward_[level];
-    while (p && comparator_(p->key_, key) < 0) {
-      p = p->forward_[level];
-      cur = cur->forward_[level];
+void SKIPLIST_TYPE::RefitAnchors(size_t segment) {
+  size_t begin = model_.SegmentBegin(segment);
+  size_t end = model_.SegmentEnd(segment);
+  bool last_segment = segment + 1 == model_.Segments();
+  int64_t lower = model_.SegmentKey(segment);
+  int64_t upper = last_segment ? 0 : model_.SegmentKey(segment + 1);
+  // The segment takes the anchors Predict sends to it: from its first key on (from the start for the first segment)
+  // up to the next segment's. The entry before it holds a node on anchor_level_ before all of them.
+  std::vector<int64_t> keys;
+  std::vector<SkipListNode *> nodes;
+  auto p = (begin == 0 ? head_ : anchor_nodes_[begin - 1])->forward_[anchor_level_];
+  for (; p != nullptr; p = p->forward_[anchor_level_]) {
+    int64_t key = p->key_.ToInteger();
+    if (!last_segment && key >= upper) {
+      break;
     }
-    if (p && comparator_(p->key_, key) == 0) {
-      LOG_WARN("The key: %lu has already existed!", key.ToInteger());
-      rwlatch_.WUnLock();
-      return false;
+    if (segment == 0 || key >= lower) {
+      keys.push_back(key);
+      nodes.push_back(p);
     }
-    level--;
   }
+  anchor_keys_.erase(anchor_keys_.begin() + begin, anchor_keys_.begin() + end);
+  anchor_keys_.insert(anchor_keys_.begin() + begin, keys.begin(), keys.end());
+  anchor_nodes_.erase(anchor_nodes_.begin() + begin, anchor_nodes_.begin() + end);
+  anchor_nodes_.insert(anchor_nodes_.begin() + begin, nodes.begin(), nodes.end());
+  // Entries behind that were patched over to a node before the segment's anchors now get the last of them, so the
+  // nodes still never go down along the array.
+  for (size_t i = begin + nodes.size(); !nodes.empty() && i < anchor_nodes_.size(); i++) {
+    if (anchor_nodes_[i] != head_ && comparator_(anchor_nodes_[i]->key_, nodes.back()->key_) >= 0) {
+      break;
+    }
+    anchor_nodes_[i] = nodes.back();
+  }
+  size_t segments = model_.Segments();
+  model_.Refit(anchor_keys_, segment, begin, begin + keys.size(), learned_epsilon_);
+  stale_segments_.erase(stale_segments_.begin() + segment);
+  stale_segments_.insert(stale_segments_.begin() + segment, model_.Segments() + 1 - segments, 0);
+  LOG_INFO("Refit learned index segment %lu: %lu anchors instead of %lu", segment, keys.size(), end - begin);
+  AccountLearnedMemory();
+}
 
-  size_t height = RandomHeight();
-  LOG_INFO("ThreadID: %lu, Insert: <%ld, %ld> with height: %lu",
-           std::hash<std::thread::id>{}(std::this_thread::get_id()), key.ToInteger(), value, height);
-  SkipListNode *new_node = new SkipListNode(key, value, height);
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::AccountLearnedMemory() {
+  size_t memory = anchor_keys_.capacity() * sizeof(int64_t) + anchor_nodes_.capacity() * sizeof(SkipListNode *) +
+                  stale_segments_.capacity() * sizeof(size_t) + model_.MemoryUsage();
+  memory_usage_.fetch_add(memory, std::memory_order_relaxed);
+  memory_usage_.fetch_sub(learned_memory_, std::memory_order_relaxed);
+  learned_memory_ = memory;
+}
 
-  level = max_height_ - 1;
-  cur = head_;
-  while (level >= 0) {
-    auto p = cur->forward_[level];
-    while (p && comparator_(p->key_, key) < 0) {
-      p = p->forward_[level];
-      cur = cur->forward_[level];
+SKIPLIST_TEMPLATE_ARGUMENTS
+size_t SKIPLIST_TYPE::AnchorLowerBound(int64_t key) {
+  size_t size = anchor_keys_.size();
+  // The model is off by at most epsilon for an anchor key and epsilon + 1 for a key between two.
+  size_t guess = model_.Predict(key);
+  size_t lo = guess > learned_epsilon_ + 1 ? guess - learned_epsilon_ - 1 : 0;
+  size_t hi = std::min(size, guess + learned_epsilon_ + 2);
+  auto first = anchor_keys_.begin();
+  size_t i = std::lower_bound(first + lo, first + hi, key) - first;
+  // Rounding could still push the answer just out of the window; the neighbours tell.
+  if ((i == lo && lo != 0 && anchor_keys_[lo - 1] >= key) || (i == hi && hi != size && anchor_keys_[hi] < key)) {
+    i = std::lower_bound(first, first + size, key) - first;
+  }
+  return i;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+size_t SKIPLIST_TYPE::RetargetAnchors(SkipListNode *first, SkipListNode *last, SkipListNode *prev) {
+  // Entries holding the run start at the first anchor key >= first's, behind any that hold nodes before first (the
+  // entries' nodes only go up), and end at the first entry holding a node past last.
+  size_t i = std::lower_bound(anchor_keys_.begin(), anchor_keys_.end(), first->key_.ToInteger()) - anchor_keys_.begin();
+  size_t moved = 0;
+  for (; i < anchor_nodes_.size(); i++) {
+    auto node = anchor_nodes_[i];
+    if (node == head_ || comparator_(node->key_, first->key_) < 0) {
+      continue;
     }
-    if (level < static_cast<int>(height)) {
-      new_node->forward_[level] = cur->forward_[level];
-      cur->forward_[level] = new_node;
+    if (comparator_(node->key_, last->key_) > 0) {
+      break;
     }
-    level--;
+    anchor_nodes_[i] = prev;
+    moved++;
   }
-  size_ += 1;
+  return moved;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::EnableChangeFeed(size_t capacity) {
+  rwlatch_.WLock();
+  change_feed_ = std::make_shared<ChangeFeed<KeyType, ValueType>>(capacity);
   rwlatch_.WUnLock();
-  return true;
 }
 
 SKIPLIST_TEMPLATE_ARGUMENTS
-bool SKIPLIST_TYPE::Remove(const KeyType &key) {
-  // std::lock_guard<std::mutex> _(mtx_);
+std::unique_ptr<typename ChangeFeed<KeyType, ValueType>::Subscriber> SKIPLIST_TYPE::Subscribe() {
+  rwlatch_.RLock();
+  auto subscriber = change_feed_ == nullptr ? nullptr : change_feed_->Subscribe();
+  rwlatch_.RUnLock();
+  return subscriber;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::RecordChanges(ChangeOp op, SkipListNode *first, SkipListNode *last) {
+  if (change_feed_ == nullptr) {
+    return;
+  }
+  for (auto p = first;; p = p->forward_[0]) {
+    change_feed_->Append(op, p->key_, p->value_);
+    if (p == last) {
+      break;
+    }
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::SetMemoryLimit(size_t limit, std::function<void()> on_full, double slowdown_ratio,
+                                   std::chrono::microseconds max_delay) {
   rwlatch_.WLock();
-  LOG_INFO("Remove: %ld", key.ToInteger());
+  on_full_ = std::move(on_full);
+  slowdown_ratio_ = slowdown_ratio;
+  max_delay_ = max_delay;
+  memory_limit_.store(limit);
+  full_signaled_.store(false);
+  rwlatch_.WUnLock();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::ThrottleWriter() {
+  size_t limit = memory_limit_.load(std::memory_order_relaxed);
+  if (limit == 0 || max_delay_.count() == 0) {
+    return;
+  }
+  auto slowdown = static_cast<size_t>(limit * slowdown_ratio_);
+  size_t usage = memory_usage_.load(std::memory_order_relaxed);
+  if (usage <= slowdown || usage >= limit) {
+    return;
+  }
+  // Linear in the distance covered from the slowdown point to the limit.
+  auto delay = max_delay_.count() * static_cast<double>(usage - slowdown) / (limit - slowdown);
+  std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(delay));
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::SignalFull() {
+  if (Full() && !full_signaled_.exchange(true)) {
+    LOG_WARN("SkipList is full: %lu bytes", memory_usage_.load());
+    if (on_full_) {
+      on_full_();
+    }
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::ResetMemoryUsage() {
+  size_t filter_memory = 0;
+  for (const auto &filter : retired_filters_) {
+    filter_memory += filter->MemoryUsage();
+  }
+  auto filter = filter_.load(std::memory_order_relaxed);
+  if (filter != nullptr) {
+    filter_memory += filter->MemoryUsage();
+  }
+  memory_usage_.store(filter_memory + learned_memory_);
+  full_signaled_.store(false);
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+size_t SKIPLIST_TYPE::Rank(const KeyType &key) {
+  rwlatch_.RLock();
+  size_t rank = RankOf(key);
+  rwlatch_.RUnLock();
+  return rank;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::Select(size_t index, KeyType *key, ValueType *value) {
+  rwlatch_.RLock();
+  auto node = NodeAt(index);
+  if (node == nullptr) {
+    rwlatch_.RUnLock();
+    return false;
+  }
+  *key = node->key_;
+  *value = node->value_;
+  rwlatch_.RUnLock();
+  return true;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+size_t SKIPLIST_TYPE::CountRange(const KeyType &begin, const KeyType &end) {
+  rwlatch_.RLock();
+  size_t lower = RankOf(begin);
+  size_t upper = RankOf(end);
+  rwlatch_.RUnLock();
+  return upper > lower ? upper - lower : 0;
+}
 
+SKIPLIST_TEMPLATE_ARGUMENTS
+size_t SKIPLIST_TYPE::RankOf(const KeyType &key) {
   int level = max_height_ - 1;
   auto cur = head_;
-  SkipListNode *delete_node = nullptr;
+  size_t rank = 0;
   while (level >= 0) {
     auto p = cur->forward_[level];
     while (p && comparator_(p->key_, key) < 0) {
+      rank += cur->span_[level];
       p = p->forward_[level];
       cur = cur->forward_[level];
     }
-    if (p && comparator_(p->key_, key) == 0) {
-      delete_node = p;
-      cur->forward_[level] = p->forward_[level];
+    level--;
+  }
+  return rank;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+typename SKIPLIST_TYPE::SkipListNode *SKIPLIST_TYPE::NodeAt(size_t index) {
+  if (index >= size_) {
+    return nullptr;
+  }
+  // The index-th key sits at rank index + 1, head_ being rank 0.
+  size_t target = index + 1;
+  size_t rank = 0;
+  int level = max_height_ - 1;
+  auto cur = head_;
+  while (level >= 0) {
+    while (cur->forward_[level] && rank + cur->span_[level] <= target) {
+      rank += cur->span_[level];
+      cur = cur->forward_[level];
+    }
+    if (rank == target) {
+      return cur;
     }
     level--;
   }
-  if (delete_node == nullptr) {
-    LOG_WARN("The key is not exists.");
-    rwlatch_.WUnLock();
-    return false;
+  return nullptr;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void *SKIPLIST_TYPE::AllocateNode(size_t height) {
+  void *mem = free_nodes_[height - 1];
+  if (mem == nullptr && detached_ != nullptr) {
+    // Drain what RemoveRange cut out a batch per allocation, rather than all at once under its latch.
+    ReclaimDetached(16);
+    mem = free_nodes_[height - 1];
+  }
+  if (mem != nullptr) {
+    free_nodes_[height - 1] = *reinterpret_cast<SkipListNode **>(free_nodes_[height - 1] + 1);
+    return mem;
+  }
+  memory_usage_.fetch_add(SkipListNode::AllocSize(height), std::memory_order_relaxed);
+  return arena_->Allocate(SkipListNode::AllocSize(height), alignof(SkipListNode));
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::FreeNode(SkipListNode *node) {
+  size_t height = node->height_;
+  node->~SkipListNode();
+  // The memory stays in the arena, chained through the raw slot where forward_[0] used to live.
+  *reinterpret_cast<SkipListNode **>(node + 1) = free_nodes_[height - 1];
+  free_nodes_[height - 1] = node;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::ReclaimDetached(size_t max_nodes) {
+  auto filter = filter_.load(std::memory_order_relaxed);
+  for (; detached_ != nullptr && max_nodes > 0; max_nodes--) {
+    auto node = detached_;
+    detached_ = node->forward_[0];
+    if (filter != nullptr) {
+      filter->Delete(&node->key_, sizeof(KeyType));
+    }
+    FreeNode(node);
   }
-  delete delete_node;
-  size_ -= 1;
-  rwlatch_.WUnLock();
-  return true;
 }
 
 SKIPLIST_TEMPLATE_ARGUMENTS
-typename SKIPLIST_TYPE::SkipListNode *SKIPLIST_TYPE::CreateNode(const KeyType &key, const ValueType &value,
-                                                                int height) {
-  LOG_INFO("CreateNode with level: %d", height);
-  SkipListNode *new_node = new SkipListNode(key, value, height);
-  assert(new_node != nullptr);
-  return new_node;
+void SKIPLIST_TYPE::DestroyNodes(SkipListNode *head) {
+  // Trivial keys and values leave nothing to run, the arena blocks are all there is to free.
+  if (std::is_trivially_destructible<KeyType>::value && std::is_trivially_destructible<ValueType>::value) {
+    return;
+  }
+  while (head != nullptr) {
+    auto next = head->forward_[0];
+    head->~SkipListNode();
+    head = next;
+  }
 }
 
 SKIPLIST_TEMPLATE_ARGUMENTS
@@ -156,58 +1365,264 @@ void SKIPLIST_TYPE::Print() {
 
 SKIPLIST_TEMPLATE_ARGUMENTS
 void SKIPLIST_TYPE::InsertFromFile(const std::string &file_name) {
-  std::ifstream input(file_name);
-  if (!input) {
-    std::cout << "Can't open the file: " << file_name << std::endl;
+  LoadStats stats;
+  if (!LoadFromFile(file_name, FileFormat::TEXT, 0, &stats)) {
+    std::cout << "Can't load the file: " << file_name << std::endl;
     return;
   }
-  int64_t key;
-  int64_t value;
-  KeyType index_key;
-  ValueType index_value;
-  while (input) {
-    input >> key >> value;
-    std::cout << "<" << key << "," << value << ">" << std::endl;
-    index_key.SetFromInteger(key);
-    index_value.SetFromInteger(value);
-    Insert(index_key, index_value);
+  std::cout << "Inserted " << stats.inserted_ << " of " << stats.records_ << " pairs at " << stats.MBPerSecond()
+            << " MB/s" << std::endl;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::LoadFromFile(const std::string &file_name, FileFormat format, size_t threads, LoadStats *stats) {
+  using Loader = FileLoader<KeyType, ValueType, KeyComparator>;
+  auto start_time = std::chrono::steady_clock::now();
+  LoadStats local_stats;
+  if (stats == nullptr) {
+    stats = &local_stats;
+  }
+  *stats = LoadStats{};
+  if (threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  std::vector<std::vector<typename Loader::Entry>> runs;
+  if (!Loader::Parse(file_name, format, threads, comparator_, &runs, stats)) {
+    LOG_WARN("Can't load the file: %s", file_name.c_str());
+    return false;
+  }
+  stats->parse_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  // Merge through a min-heap of run indexes, the earlier run first on equal keys so that file order decides.
+  std::vector<size_t> positions(runs.size(), 0);
+  auto later = [this, &runs, &positions](size_t lhs, size_t rhs) {
+    int cmp = comparator_(runs[lhs][positions[lhs]].first, runs[rhs][positions[rhs]].first);
+    return cmp > 0 || (cmp == 0 && lhs > rhs);
+  };
+  std::vector<size_t> heap;
+  for (size_t i = 0; i < runs.size(); i++) {
+    if (!runs[i].empty()) {
+      heap.push_back(i);
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), later);
+  bool full = false;
+  while (!heap.empty() && !full) {
+    ThrottleWriter();
+    rwlatch_.WLock();
+    // Other writers may have moved update_ since the last batch, so each batch starts its first search from the top.
+    bool finger = false;
+    for (size_t batch = 0; batch < BULK_BATCH && !heap.empty(); batch++) {
+      if (Full()) {
+        full = true;
+        break;
+      }
+      std::pop_heap(heap.begin(), heap.end(), later);
+      size_t run = heap.back();
+      auto &entry = runs[run][positions[run]];
+      if (FindInsertPosition(entry.first, finger)) {
+        LinkNode(CreateNode(RandomHeight(), std::move(entry.first), std::move(entry.second)));
+        stats->inserted_++;
+      }
+      finger = true;
+      if (++positions[run] == runs[run].size()) {
+        heap.pop_back();
+      } else {
+        std::push_heap(heap.begin(), heap.end(), later);
+      }
+    }
+    rwlatch_.WUnLock();
+  }
+  SignalFull();
+  stats->seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  LOG_INFO("Loaded %lu of %lu pairs from %s at %.1f MB/s", stats->inserted_, stats->records_, file_name.c_str(),
+           stats->MBPerSecond());
+  return true;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+std::unique_ptr<FrozenSkipList<KeyType, ValueType, KeyComparator>> SKIPLIST_TYPE::Freeze() {
+  rwlatch_.RLock();
+  LOG_INFO("Freeze %lu entries", size_);
+  std::vector<KeyType> keys;
+  std::vector<ValueType> values;
+  keys.reserve(size_);
+  values.reserve(size_);
+  for (auto p = head_->forward_[0]; p != nullptr; p = p->forward_[0]) {
+    keys.push_back(p->key_);
+    values.push_back(p->value_);
+  }
+  rwlatch_.RUnLock();
+  return std::unique_ptr<FrozenSkipList<KeyType, ValueType, KeyComparator>>(
+      new FrozenSkipList<KeyType, ValueType, KeyComparator>(comparator_, std::move(keys), std::move(values)));
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::Flush(const std::string &file_name, bool compress) {
+  using Writer = SortedRunWriter<KeyType, ValueType, KeyComparator>;
+  Writer writer(file_name, comparator_, Writer::DEFAULT_BLOCK_SIZE, Writer::DEFAULT_RESTART_INTERVAL, compress);
+  rwlatch_.RLock();
+  LOG_INFO("Flush %lu entries to %s", size_, file_name.c_str());
+  bool ok = true;
+  for (auto p = head_->forward_[0]; p != nullptr && ok; p = p->forward_[0]) {
+    ok = writer.Add(p->key_, p->value_);
   }
+  rwlatch_.RUnLock();
+  return ok && writer.Finish();
 }
 
 ////////////////// Iterator /////////////////
 SKIPLIST_TEMPLATE_ARGUMENTS
 typename SKIPLIST_TYPE::Iterator SKIPLIST_TYPE::begin() {
   LOG_INFO("Iterator begin");
-  return Iterator{head_->forward_[0]};
+  return Iterator{head_->forward_[0], this};
 }
 
 SKIPLIST_TEMPLATE_ARGUMENTS
 typename SKIPLIST_TYPE::Iterator SKIPLIST_TYPE::end() {
   LOG_INFO("Iterator end");
-  // int level = max_height_ - 1;
-  // auto cur = head_;
-  // while (level >= 0) {
-  //   auto p = cur->forward_[level];
-  //   while (p) {
-  //     p = p->forward_[level];
-  //     cur = cur->forward_[level];
-  //   }
-  //   level--;
-  // }
-  // return Iterator{cur->forward_[0]};
-  return Iterator{nullptr};
+  return Iterator{nullptr, this};
 }
 
 SKIPLIST_TEMPLATE_ARGUMENTS
-SKIPLIST_TYPE::~SkipList() {
-  if (head_ != nullptr) {
-    while (head_->forward_[0] != nullptr) {
-      auto node = head_->forward_[0];
-      head_->forward_[0] = node->forward_[0];
-      delete node;
+typename SKIPLIST_TYPE::Iterator SKIPLIST_TYPE::Seek(size_t position) {
+  rwlatch_.RLock();
+  auto node = NodeAt(position);
+  rwlatch_.RUnLock();
+  return Iterator{node, this};
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+typename SKIPLIST_TYPE::Iterator SKIPLIST_TYPE::SeekForPrev(const KeyType &key) {
+  rwlatch_.RLock();
+  int level = max_height_ - 1;
+  auto cur = head_;
+  while (level >= 0) {
+    auto p = cur->forward_[level];
+    while (p && comparator_(p->key_, key) <= 0) {
+      p = p->forward_[level];
+      cur = cur->forward_[level];
+    }
+    level--;
+  }
+  rwlatch_.RUnLock();
+  return Iterator{cur == head_ ? nullptr : cur, this};
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+typename SKIPLIST_TYPE::Iterator SKIPLIST_TYPE::LowerBound(const KeyType &key) {
+  rwlatch_.RLock();
+  auto cur = head_;
+  for (int level = max_height_ - 1; level >= 0; level--) {
+    while (cur->forward_[level] && comparator_(cur->forward_[level]->key_, key) < 0) {
+      cur = cur->forward_[level];
     }
-    delete head_;
   }
+  rwlatch_.RUnLock();
+  return Iterator{cur->forward_[0], this};
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::Clear(bool background) {
+  rwlatch_.WLock();
+  LOG_INFO("Clear %lu entries", size_);
+  std::shared_ptr<Arena> old_arena(new Arena(Arena::DEFAULT_BLOCK_SIZE, huge_pages_, numa_interleave_));
+  old_arena.swap(arena_);
+  std::vector<std::shared_ptr<Arena>> old_borrowed;
+  old_borrowed.swap(borrowed_arenas_);
+  SkipListNode *old_head = head_;
+  SkipListNode *old_detached = detached_;
+  detached_ = nullptr;
+  RestartEmpty();
+  rwlatch_.WUnLock();
+
+  if (!background) {
+    DestroyNodes(old_head);
+    DestroyNodes(old_detached);
+    return;
+  }
+  if (reclaimer_.joinable()) {
+    reclaimer_.join();
+  }
+  reclaimer_ = std::thread(
+      [old_head, old_detached, arena = std::move(old_arena), borrowed = std::move(old_borrowed)]() mutable {
+        DestroyNodes(old_head);
+        DestroyNodes(old_detached);
+        arena.reset();
+        borrowed.clear();
+      });
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::Reset() {
+  rwlatch_.WLock();
+  LOG_INFO("Reset %lu entries", size_);
+  DestroyNodes(head_);
+  DestroyNodes(detached_);
+  detached_ = nullptr;
+  borrowed_arenas_.clear();
+  if (arena_.use_count() == 1) {
+    arena_->Reset();
+  } else {
+    // Lists split off from this one still have nodes in it.
+    arena_.reset(new Arena(Arena::DEFAULT_BLOCK_SIZE, huge_pages_, numa_interleave_));
+  }
+  RestartEmpty();
+  rwlatch_.WUnLock();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+bool SKIPLIST_TYPE::UseHugePages(bool numa_interleave) {
+  rwlatch_.WLock();
+  if (size_ != 0) {
+    LOG_WARN("Only an empty SkipList can change its page mode");
+    rwlatch_.WUnLock();
+    return false;
+  }
+  huge_pages_ = true;
+  numa_interleave_ = numa_interleave;
+  DestroyNodes(head_);
+  DestroyNodes(detached_);
+  detached_ = nullptr;
+  borrowed_arenas_.clear();
+  arena_.reset(new Arena(Arena::DEFAULT_BLOCK_SIZE, huge_pages_, numa_interleave_));
+  RestartEmpty();
+  rwlatch_.WUnLock();
+  return true;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+void SKIPLIST_TYPE::RestartEmpty() {
+  std::fill(free_nodes_.begin(), free_nodes_.end(), nullptr);
+  ResetMemoryUsage();
+  head_ = CreateNode(max_height_, KeyType{});
+  tail_ = nullptr;
+  if (learned_index_) {
+    TrainLearnedIndex();
+  }
+  size_ = 0;
+  expiry_heap_.clear();
+  promoted_.clear();
+  auto filter = filter_.load(std::memory_order_relaxed);
+  if (filter != nullptr) {
+    filter->Clear();
+  }
+  if (change_feed_ != nullptr) {
+    change_feed_->Append(ChangeOp::CLEAR, KeyType{}, ValueType{});
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+SKIPLIST_TYPE::~SkipList() {
+  StopSweeper();
+  StopRebalancer();
+  if (reclaimer_.joinable()) {
+    reclaimer_.join();
+  }
+  // Nodes live in arena_ and borrowed_arenas_, which release them block by block.
+  DestroyNodes(head_);
+  DestroyNodes(detached_);
+  delete filter_.load();
 }
 
 template class SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
@@ -1,10 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <mutex>  // NOLINT
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>   // NOLINT
+#include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
+#include "arena.h"
+#include "bloom_filter.h"
+#include "change_feed.h"
+#include "coroutine.h"
+#include "file_loader.h"
+#include "frozen_skiplist.h"
 #include "generic_key.h"
+#include "learned_index.h"
 #include "logger.h"
 #include "rwlatch.h"
 
@@ -20,50 +36,315 @@ class SkipList {
                     size_t rnd = 0xdeadbeef);
 
   bool Insert(const KeyType &key, const ValueType &value);
+  bool Insert(KeyType &&key, ValueType &&value);
+  // Construct the value in place from args, only once the key is known to be absent.
+  template <typename K, typename... Args>
+  bool Emplace(K &&key, Args &&... args);
   bool Remove(const KeyType &key);
+  // Remove every key in [begin, end) and return how many went. The write latch covers two descents and one splice per
+  // level, whatever the size of the range; the detached nodes are handed back to the free lists a few at a time by
+  // later inserts. Always writes directly, also in flat-combining mode.
+  size_t RemoveRange(const KeyType &begin, const KeyType &end);
+  // Move every key >= key into a new list of the same shape and return it. The nodes are relinked, not copied: one
+  // descent and max_height link updates, with the new list sharing this list's arena for them. Expiry entries and
+  // promoted keys follow their nodes. The new list starts without a filter; this one keeps the moved keys in its
+  // filter, as false positives.
+  std::unique_ptr<SkipList> Split(const KeyType &key);
+  // Move every entry of other into this list, in front of or behind its own; false, with neither list changed, unless
+  // the keys of one list all sort below those of the other. Costs a walk to the last node of one list and max_height
+  // link updates; a list built with a lower max_height first grows its head. other is left empty and usable. With a
+  // filter, this list rebuilds it once to learn the keys of other.
+  bool Join(SkipList *other);
   bool Lookup(const KeyType &key, std::vector<ValueType> *result);
 
+  // Set algebra on the keys of this list and other. Both lists are walked together, and the side that is behind
+  // gallops to the other's key along the path of its previous search: up while the path's next node one level higher
+  // still falls short, then down. Skipping d keys costs O(log d), so intersecting m keys with n costs O(m log(n / m))
+  // instead of m lookups.
+  // A key in both lists takes its value from this one. These hold both read latches, taken in address order, and
+  // append the result in key order to a new list of this list's shape. Expired entries count as absent on both sides,
+  // here and in View().
+  enum class SetOperation { INTERSECT, UNION, DIFFERENCE };
+  std::unique_ptr<SkipList> Intersect(SkipList *other);
+  std::unique_ptr<SkipList> Union(SkipList *other);
+  std::unique_ptr<SkipList> Difference(SkipList *other);  // keys of this list that other lacks
+  size_t CountIntersection(SkipList *other);
+
+  // Insert an entry that expires ttl from now. Lookups treat an expired entry as absent and a new Insert of its key
+  // replaces it; until then it still occupies the list, counts in Size() and shows up in iterators.
+  bool InsertWithTTL(const KeyType &key, const ValueType &value, std::chrono::milliseconds ttl);
+  // Remove up to max_nodes expired entries in one write latch hold and return how many went. Candidates come from a
+  // min-heap on expiry time, so the list itself is never scanned.
+  size_t EvictExpired(size_t max_nodes);
+  // Run EvictExpired(slice) on a background thread, back to back while it finds full slices and once per interval
+  // otherwise.
+  void StartSweeper(std::chrono::milliseconds interval = std::chrono::milliseconds(100), size_t slice = 64);
+  void StopSweeper();
+
+  // Access-biased heights for skewed lookups. Once enabled, Lookup counts one in every sample_rate lookups (rounded up
+  // to a power of two) on the node it found. Rebalance then gives the hot_keys most counted keys taller towers: the
+  // hottest one max_height, each next group branching times larger one level less, so they are met within a few hops
+  // of the top. Keys that fall out of the hot set go back to a random height. Counts are halved on every Rebalance, so
+  // the hot set follows a drifting workload. Only the re-heighting holds the write latch; counting runs under the read
+  // latch.
+  void SetAccessBias(bool enable, size_t sample_rate = 16);
+  void Rebalance(size_t hot_keys = 1024);
+  // Run Rebalance(hot_keys) on a background thread once per interval.
+  void StartRebalancer(std::chrono::milliseconds interval = std::chrono::milliseconds(1000), size_t hot_keys = 1024);
+  void StopRebalancer();
+
+  // In flat-combining mode Insert and Remove publish their request instead of taking the write latch themselves. One
+  // writer at a time becomes the combiner, sorts every pending request and applies the whole batch in one pass under
+  // a single latch hold, resuming each search from the previous key's path. Emplace always writes directly.
+  void SetFlatCombining(bool enable) { flat_combining_.store(enable); }
+
+  // Call fn(const ValueType &) on the stored value instead of copying it out. fn runs under the read latch.
+  template <typename Fn>
+  bool Lookup(const KeyType &key, Fn &&fn);
+
+#ifdef __cpp_impl_coroutine
+  // Awaitable Lookup. It only interleaves inside an InterleavedExecutor: there a busy latch suspends the coroutine
+  // instead of the thread (unless every other task waits for it too, which parks the thread), and the descent
+  // prefetches every next node and yields to the other tasks while it arrives. Elsewhere it runs like Lookup.
+  // The read latch is held across the prefetch suspensions, since nodes may be freed once it is released, so writers
+  // wait for the whole lookup.
+  Task<bool> LookupAsync(KeyType key, std::vector<ValueType> *result);
+#endif
+
+  // Put a counting Bloom filter in front of Lookup: a definite miss returns before the latch and the descent. The
+  // filter is sized for expected_keys and rebuilt twice as large once the list outgrows that.
+  void EnableFilter(size_t expected_keys, size_t cells_per_key = 10);
+  // Share of filtered lookups for absent keys that the filter let through.
+  double FilterFalsePositiveRate();
+  // Filter memory per stored key, in bits.
+  double FilterBitsPerKey();
+
+  // Learned index over the upper levels, for keys whose ToInteger() orders them as the comparator does. The nodes
+  // taller than anchor_level (one in branching^anchor_level) are anchors, and a piecewise-linear model trained on
+  // their keys (see learned_index.h) predicts which anchor a key falls behind to within epsilon. Lookup then binary
+  // searches that window instead of descending the levels above anchor_level, and walks down from the anchor. Writers
+  // patch removed anchors out in place, and new ones only lengthen that walk; once a quarter of the anchors of one
+  // segment have come or gone, the writer that tips it over refits that segment alone, which holds a few hundred
+  // anchors at most. Disabling drops the model. A list of height 1 has no levels to skip and stays without one.
+  void EnableLearnedIndex(bool enable, size_t anchor_level = 3, size_t epsilon = 16);
+  // Segments of the current model, 0 when disabled.
+  size_t LearnedSegments();
+
+  // Change feed for mirrors of this list (see change_feed.h). Once enabled, every change appends records under the
+  // write latch: INSERT for each entry Insert, Emplace, InsertWithTTL, LoadFromFile or Join links, REMOVE for each
+  // entry Remove, RemoveRange, EvictExpired or Split takes out, CLEAR for Clear and Reset. RemoveRange, Split and Join
+  // then pay a walk over the keys they move. Enabling again starts a new feed, and the old one stops growing.
+  void EnableChangeFeed(size_t capacity = ChangeFeed<KeyType, ValueType>::DEFAULT_CAPACITY);
+  // A subscriber starting with the next change; nullptr while no feed is enabled.
+  std::unique_ptr<typename ChangeFeed<KeyType, ValueType>::Subscriber> Subscribe();
+
+  // Bytes held by the list: the arena space carved out for nodes (key, value, links and spans; a removed node stays
+  // counted until its slot is reused), the Bloom filters, the learned index and the expiry heap. Memory owned by the
+  // keys and values themselves is not seen.
+  size_t ApproximateMemoryUsage() { return memory_usage_.load(std::memory_order_relaxed); }
+  // Once ApproximateMemoryUsage() reaches limit (0 lifts the budget), Insert, Emplace and InsertWithTTL fail and Full()
+  // turns true until the next Clear() or Reset(). on_full runs once per fill, on the writer that found the list full
+  // and outside the latch, so it can hand the list to a flush. Beyond slowdown_ratio of the limit every insert first
+  // sleeps, up to max_delay close to the limit, so the flush pipeline keeps up instead of writers hitting the wall.
+  // Set the budget before writers start.
+  void SetMemoryLimit(size_t limit, std::function<void()> on_full = nullptr, double slowdown_ratio = 1.0,
+                      std::chrono::microseconds max_delay = std::chrono::microseconds(0));
+  bool Full() {
+    size_t limit = memory_limit_.load(std::memory_order_relaxed);
+    return limit != 0 && memory_usage_.load(std::memory_order_relaxed) >= limit;
+  }
+
+  // Positional queries, all O(log n) through the per-link spans.
+  size_t Rank(const KeyType &key);  // number of keys < key
+  bool Select(size_t index, KeyType *key, ValueType *value);  // the index-th (0-based) key
+  size_t CountRange(const KeyType &begin, const KeyType &end);  // number of keys in [begin, end)
+
+  // Call fn(key, value) for every live key in [begin, end), spread over `threads` threads (the caller included). The
+  // range is cut by rank into equal, disjoint slices through the spans, and the read latch is held until every slice
+  // is done, so the scan sees one consistent list. fn runs concurrently and must be thread-safe.
+  template <typename Fn>
+  void ParallelForEach(const KeyType &begin, const KeyType &end, Fn &&fn, size_t threads);
+  // The same over the whole list.
+  template <typename Fn>
+  void ParallelForEach(Fn &&fn, size_t threads);
+
   size_t Size() { return size_; }
   void Print();
+  // Text files only, through LoadFromFile; prints one summary line.
   void InsertFromFile(const std::string &file_name);
+  // Bulk load key/value pairs from file_name (see file_loader.h for the formats). The file is parsed and sorted in
+  // chunks on `threads` threads (0: one per core), then the sorted chunks are merged into the list in key order,
+  // BULK_BATCH inserts per write latch hold, each search resuming from the previous key's path. Existing keys are
+  // kept; of two equal keys in the file, the first wins. False if the file cannot be read or is malformed; nothing is
+  // inserted then. stats, if given, reports the counts and the throughput.
+  bool LoadFromFile(const std::string &file_name, FileFormat format = FileFormat::TEXT, size_t threads = 0,
+                    LoadStats *stats = nullptr);
+
+  // Copy the level-0 chain into an immutable FrozenSkipList. A sealed memtable can then be Clear()ed and served from
+  // the frozen copy, which keeps no forward pointers.
+  std::unique_ptr<FrozenSkipList<KeyType, ValueType, KeyComparator>> Freeze();
+  // Stream the level-0 chain into an immutable on-disk SortedRun (see sorted_run.h). Only the read latch is held, so
+  // lookups keep being served while a sealed memtable is flushed in the background.
+  bool Flush(const std::string &file_name, bool compress = false);
+
+  // Drop every entry by releasing the arena blocks wholesale. With `background` the old blocks (and the destructors
+  // of non-trivial keys/values) are reclaimed on a helper thread, so the caller returns in O(1).
+  void Clear(bool background = false);
+  // Drop every entry but keep the arena blocks, so the next generation of inserts reuses the same memory.
+  void Reset();
+  // Carve nodes from 2MB pages (see Arena), optionally interleaved over the NUMA nodes. Only an empty list can switch;
+  // returns false otherwise. The mode sticks across Clear() and Reset().
+  bool UseHugePages(bool numa_interleave = false);
 
   ~SkipList();
 
  private:
+  // Nodes are placement-constructed by CreateNode inside arena memory that has room for the forward_ and span_
+  // arrays right behind the node itself.
   class SkipListNode {
    public:
-    explicit SkipListNode(const KeyType &key, const ValueType &value, int height)
-        : key_(key), value_(value), height_(height) {
+    template <typename K, typename... Args>
+    explicit SkipListNode(int height, K &&key, Args &&... args)
+        : key_(std::forward<K>(key)), value_(std::forward<Args>(args)...), height_(height) {
       assert(0 < height);  // 0 represent the lowest level.
-      forward_ = static_cast<SkipListNode **>(new SkipListNode *[height]);
+      forward_ = reinterpret_cast<SkipListNode **>(this + 1);
+      span_ = reinterpret_cast<size_t *>(forward_ + height);
       for (int i = 0; i < height; i++) {
         forward_[i] = nullptr;
+        span_[i] = 0;
       }
     }
 
-    ~SkipListNode() {
-      if (forward_ != nullptr) {
-        delete[] forward_;
-      }
+    static size_t AllocSize(size_t height) {
+      return sizeof(SkipListNode) + height * (sizeof(SkipListNode *) + sizeof(size_t));
     }
 
     KeyType key_;
     ValueType value_;
-    size_t height_;           // for delete operation
+    SkipListNode *prev_{nullptr};  // level-0 back pointer, nullptr for the first node
+    uint64_t expire_at_{0};        // steady clock milliseconds, 0 if the entry never expires
+    uint32_t height_;              // for delete operation
+    std::atomic<uint32_t> hits_{0};  // sampled lookups, see SetAccessBias
     SkipListNode **forward_;  // The forward pointers array
+    // span_[i] is the number of level-0 hops from this node to forward_[i]. A null link spans to the last node, so
+    // head_->span_[i] is size_ on a level with no nodes, and the spans still sum to the rank of any node on the
+    // search path.
+    size_t *span_;
   };
-  SkipListNode *CreateNode(const KeyType &key, const ValueType &value, int height);
+  template <typename K, typename... Args>
+  SkipListNode *CreateNode(int height, K &&key, Args &&... args);
+  void *AllocateNode(size_t height);
+  void FreeNode(SkipListNode *node);
+  // First node >= key at or after from (nullptr if none), galloping from the finger path: path[level] is a node
+  // before from on that level, the closer the better, and is moved up to key's predecessor on every level searched.
+  SkipListNode *Gallop(SkipListNode *from, const KeyType &key, std::vector<SkipListNode *> *path) const;
+  std::unique_ptr<SkipList> Combine(SetOperation op, SkipList *other);
+  // Read-latch this list and other, the lower address first (see Join); a list is latched once.
+  void RLockPair(SkipList *other);
+  void RUnLockPair(SkipList *other);
+  // Give head_ max_height levels, the new ones empty.
+  void GrowHeight(size_t max_height);
+  // Keep the arenas of from alive for nodes that moved over from it. Each arena is held once, and never our own, so
+  // a list that is split and joined back over and over does not pile up references.
+  void BorrowArenas(const SkipList &from);
+  static constexpr size_t BULK_BATCH = 4096;
+  // Move up to max_nodes nodes from the detached_ chain to the free lists.
+  void ReclaimDetached(size_t max_nodes);
+  static void DestroyNodes(SkipListNode *head);
+  // What every restart of the list shares once the old nodes are taken care of: a fresh head from arena_, and every
+  // structure that refers to keys or nodes emptied with it.
+  void RestartEmpty();
   size_t RandomHeight();
+  // Unlatched search helpers. FindPath fills update_ and rank_ with the path to key and returns the first node >= key;
+  // with finger it resumes from the path already in update_, which must belong to a key <= this one.
+  // FindInsertPosition fails on a duplicate key, LinkNode then splices the node in behind update_.
+  SkipListNode *FindEqual(const KeyType &key);
+  static uint64_t NowMs();
+  static bool Expired(const SkipListNode *node) { return node->expire_at_ != 0 && node->expire_at_ <= NowMs(); }
+  static bool ExpiresLater(const std::pair<uint64_t, KeyType> &lhs, const std::pair<uint64_t, KeyType> &rhs) {
+    return lhs.first > rhs.first;
+  }
+  SkipListNode *FindPath(const KeyType &key, bool finger = false);
+  bool FindInsertPosition(const KeyType &key, bool finger = false);
+  void LinkNode(SkipListNode *node);
+  bool RemoveLocked(const KeyType &key, bool finger);
+  // Splice a node in behind update_ / out from behind it, fixing spans and back links only.
+  void SpliceNode(SkipListNode *node);
+  void UnlinkNode(SkipListNode *node);
+  // Move key's entry into a node of the given height, in place; false if key is absent.
+  bool SetHeight(const KeyType &key, size_t height);
+  void RecordAccess(SkipListNode *node) {
+    if (!access_bias_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    static thread_local uint32_t ticks = 0;
+    if ((++ticks & access_sample_mask_.load(std::memory_order_relaxed)) == 0) {
+      node->hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  // False only if key is certainly absent; always true without a filter.
+  bool FilterMayContain(const KeyType &key);
+  void RebuildFilter(size_t expected_keys);
+  // Append op for every node of the level-0 run first..last (both included) to the change feed, if there is one.
+  void RecordChanges(ChangeOp op, SkipListNode *first, SkipListNode *last);
+  // Collect the anchors from level anchor_level_ and fit the model to them; empties both when disabled.
+  void TrainLearnedIndex();
+  // Index of the first anchor key >= key: the model's window, or the whole array if the window missed.
+  size_t AnchorLowerBound(int64_t key);
+  // Move the anchor entries that hold any of the level-0 run first..last, which is being unlinked, to prev, the
+  // predecessor of first on anchor_level_, and return how many moved.
+  size_t RetargetAnchors(SkipListNode *first, SkipListNode *last, SkipListNode *prev);
+  // Count count anchors linked or unlinked with keys in [first, last] against their segments, and refit each segment
+  // once its count reaches a quarter of its anchors.
+  void NoteStaleAnchors(int64_t first, int64_t last, size_t count);
+  // Collect the anchors of segment from anchor_level_ again, splice them into the arrays and refit the segment.
+  void RefitAnchors(size_t segment);
+  // Move the memory accounted to the learned index to what it holds now.
+  void AccountLearnedMemory();
+  // Sleep in proportion to how far the list is past the slowdown point of its memory limit.
+  void ThrottleWriter();
+  // Run on_full_ if the list is full and it has not run for this fill yet.
+  void SignalFull();
+  // Restart the accounting at what survives a Clear or Reset: the filters.
+  void ResetMemoryUsage();
+
+  /************** Flat Combining **********************/
+  struct WriteRequest {
+    WriteRequest(bool insert, const KeyType *key, const ValueType *value, bool movable)
+        : insert_(insert), movable_(movable), key_(key), value_(value) {}
+
+    bool insert_;
+    bool movable_;  // key_ and value_ came from an rvalue Insert, so the new node may take them over
+    const KeyType *key_;
+    const ValueType *value_;  // nullptr for a Remove
+    bool result_{false};
+    std::atomic<bool> done_{false};
+    WriteRequest *next_{nullptr};
+  };
+  bool CombineWrite(bool insert, const KeyType *key, const ValueType *value, bool movable = false);
+  void ApplyPendingWrites();
+  // Unlatched helpers for the positional queries.
+  size_t RankOf(const KeyType &key);
+  SkipListNode *NodeAt(size_t index);
+  // Body of ParallelForEach over ranks [first, last); the caller holds the read latch.
+  template <typename Fn>
+  void ParallelScan(size_t first, size_t last, Fn &fn, size_t threads);
 
   /************** Iterator Unit **********************/
  private:
   class Iterator {
-    using KVPAIR = std::pair<KeyType, ValueType>;
+    using KVPAIR = std::pair<const KeyType &, ValueType &>;
 
    public:
-    Iterator(SkipListNode *node) { cur = node; }
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = std::pair<KeyType, ValueType>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = KVPAIR;
 
-    KVPAIR operator*() {
+    Iterator(SkipListNode *node, const SkipList *list) : cur(node), list(list) {}
+
+    KVPAIR operator*() const {
       assert(cur != nullptr);
       return KVPAIR{cur->key_, cur->value_};
     }
@@ -73,17 +354,96 @@ class SkipList {
       this->cur = this->cur->forward_[0];
       return *this;
     }
+    // Stepping back from end() lands on the tail.
+    Iterator &operator--() {
+      this->cur = this->cur == nullptr ? list->tail_ : this->cur->prev_;
+      return *this;
+    }
     bool operator==(const Iterator &itr) const { return cur == itr.cur; }
     bool operator!=(const Iterator &itr) const { return cur != itr.cur; }
     ~Iterator() = default;
 
    private:
     SkipListNode *cur;
+    const SkipList *list;
+  };
+
+ private:
+  // Walks lhs and rhs together and stops on each node of the result of op, see View().
+  class SetIterator {
+    using KVPAIR = std::pair<const KeyType &, ValueType &>;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<KeyType, ValueType>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = KVPAIR;
+
+    SetIterator(SetOperation op, const SkipList *lhs, const SkipList *rhs)
+        : op(op), lhs(lhs), a(lhs->head_->forward_[0]), b(rhs->head_->forward_[0]) {
+      a_path.assign(lhs->max_height_, lhs->head_);
+      b_path.assign(rhs->max_height_, rhs->head_);
+      Advance();
+    }
+    // end()
+    SetIterator() : op(SetOperation::INTERSECT), lhs(nullptr), a(nullptr), b(nullptr) {}
+
+    KVPAIR operator*() const {
+      assert(cur != nullptr);
+      return KVPAIR{cur->key_, cur->value_};
+    }
+
+    SetIterator &operator++() {
+      assert(cur != nullptr);
+      Advance();
+      return *this;
+    }
+    bool operator==(const SetIterator &itr) const { return cur == itr.cur; }
+    bool operator!=(const SetIterator &itr) const { return cur != itr.cur; }
+    ~SetIterator() = default;
+
+   private:
+    friend class SkipList;
+    // Move cur to the next result node and a and b past it.
+    void Advance();
+
+    SetOperation op;
+    const SkipList *lhs;  // compares, and gallops on both sides: the lists share one shape of node
+    SkipListNode *a;      // first node of lhs not yet passed, nullptr at its end
+    SkipListNode *b;      // the same on rhs
+    SkipListNode *cur{nullptr};
+    // Finger paths behind a and b, see Gallop.
+    std::vector<SkipListNode *> a_path;
+    std::vector<SkipListNode *> b_path;
+  };
+
+  class SetView {
+   public:
+    SetView(SetOperation op, const SkipList *lhs, const SkipList *rhs) : op(op), lhs(lhs), rhs(rhs) {}
+    SetIterator begin() const { return SetIterator{op, lhs, rhs}; }
+    SetIterator end() const { return SetIterator{}; }
+
+   private:
+    SetOperation op;
+    const SkipList *lhs;
+    const SkipList *rhs;
   };
 
  public:
+  // op on this list and other, lazily: the range computes one result key per step, galloping as the eager forms do.
+  // Like Iterator it takes no latch, so neither list may change while it is in use.
+  SetView View(SetOperation op, SkipList *other) { return SetView{op, this, other}; }
+
+  using ReverseIterator = std::reverse_iterator<Iterator>;
+
   Iterator begin();
   Iterator end();
+  ReverseIterator rbegin() { return ReverseIterator{end()}; }
+  ReverseIterator rend() { return ReverseIterator{begin()}; }
+  Iterator SeekForPrev(const KeyType &key);  // iterator at the last key <= key, end() if there is none
+  Iterator LowerBound(const KeyType &key);   // iterator at the first key >= key, end() if there is none
+  Iterator Seek(size_t position);  // iterator at the position-th (0-based) key, end() if out of range
 
  private:
   // std::mutex mtx_;
@@ -93,7 +453,163 @@ class SkipList {
   size_t rnd_;
   size_t size_;
   ReaderWriterLatch rwlatch_;
+  std::shared_ptr<Arena> arena_;
+  // Arenas of other lists holding nodes that Split or Join moved into this one.
+  std::vector<std::shared_ptr<Arena>> borrowed_arenas_;
+  bool huge_pages_{false};
+  bool numa_interleave_{false};
+  // Removed nodes, one free list per height, chained through their first link slot. Reused by CreateNode.
+  std::vector<SkipListNode *> free_nodes_;
+  // Nodes cut out by RemoveRange, chained through forward_[0] and not yet freed. Their keys are still in the filter.
+  SkipListNode *detached_{nullptr};
+  std::thread reclaimer_;  // background teardown started by Clear(true)
   SkipListNode *head_;
+  SkipListNode *tail_{nullptr};  // last node of level 0, nullptr when empty
+  // Search path of the current writer, only touched under the write latch.
+  std::vector<SkipListNode *> update_;  // predecessor at each level
+  std::vector<size_t> rank_;            // rank of update_[level]
+  // RemoveRange keeps the path to the end of its range here.
+  std::vector<SkipListNode *> range_end_;
+  std::vector<size_t> range_end_rank_;
+  // Flat combining: writers push onto pending_, the holder of combiner_mtx_ drains it through batch_.
+  std::atomic<bool> flat_combining_{false};
+  std::atomic<WriteRequest *> pending_{nullptr};
+  std::mutex combiner_mtx_;
+  std::vector<WriteRequest *> batch_;
+  // Membership filter, probed without the latch. Replaced filters are parked in retired_filters_ rather than freed,
+  // since a reader may still be probing them; they go with the list.
+  std::atomic<CountingBloomFilter *> filter_{nullptr};
+  std::vector<std::unique_ptr<CountingBloomFilter>> retired_filters_;
+  size_t filter_capacity_{0};
+  size_t filter_cells_per_key_{0};
+  std::atomic<size_t> filter_negatives_{0};        // lookups answered by the filter alone
+  std::atomic<size_t> filter_false_positives_{0};  // lookups the filter passed that found nothing
+  // Learned index, see EnableLearnedIndex. anchor_keys_ is sorted; anchor_nodes_[i] is the node of anchor_keys_[i] or,
+  // once that one is gone, its predecessor on anchor_level_ (head_ included). So every entry holds a live node at or
+  // before its key, and the nodes never go down along the array. Anchors linked after training are not in it.
+  bool learned_index_{false};
+  size_t anchor_level_{0};
+  size_t learned_epsilon_{0};
+  std::vector<int64_t> anchor_keys_;
+  std::vector<SkipListNode *> anchor_nodes_;
+  std::vector<size_t> stale_segments_;  // anchors linked or unlinked per segment since it was fitted
+  size_t stale_anchors_{0};  // the same while the model has no segment at all
+  size_t learned_memory_{0};
+  PiecewiseLinearModel model_;
+  std::shared_ptr<ChangeFeed<KeyType, ValueType>> change_feed_;  // nullptr unless enabled
+  // (expire_at, key) of every entry inserted with a TTL, min-heap on expire_at. Entries whose node was removed or
+  // replaced since are recognized by a different expire_at and dropped when they reach the top.
+  std::vector<std::pair<uint64_t, KeyType>> expiry_heap_;
+  std::thread sweeper_;
+  std::mutex sweeper_mtx_;
+  std::condition_variable sweeper_cv_;
+  bool sweeper_stop_{false};
+  // Access bias, see SetAccessBias. promoted_ holds the keys Rebalance raised, sorted.
+  std::atomic<bool> access_bias_{false};
+  std::atomic<uint32_t> access_sample_mask_{0};
+  std::vector<KeyType> promoted_;
+  std::thread rebalancer_;
+  std::mutex rebalancer_mtx_;
+  std::condition_variable rebalancer_cv_;
+  bool rebalancer_stop_{false};
+  // Memory budget, see SetMemoryLimit.
+  std::atomic<size_t> memory_usage_{0};
+  std::atomic<size_t> memory_limit_{0};
+  double slowdown_ratio_{1.0};
+  std::chrono::microseconds max_delay_{0};
+  std::function<void()> on_full_;
+  std::atomic<bool> full_signaled_{false};
 };
 
+SKIPLIST_TEMPLATE_ARGUMENTS
+template <typename K, typename... Args>
+bool SKIPLIST_TYPE::Emplace(K &&key, Args &&... args) {
+  ThrottleWriter();
+  rwlatch_.WLock();
+  if (Full() || !FindInsertPosition(key)) {
+    rwlatch_.WUnLock();
+    SignalFull();
+    return false;
+  }
+  LinkNode(CreateNode(RandomHeight(), std::forward<K>(key), std::forward<Args>(args)...));
+  rwlatch_.WUnLock();
+  SignalFull();
+  return true;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+template <typename Fn>
+bool SKIPLIST_TYPE::Lookup(const KeyType &key, Fn &&fn) {
+  if (!FilterMayContain(key)) {
+    return false;
+  }
+  rwlatch_.RLock();
+  auto node = FindEqual(key);
+  if (node == nullptr || Expired(node)) {
+    rwlatch_.RUnLock();
+    if (node == nullptr && filter_.load(std::memory_order_acquire) != nullptr) {
+      filter_false_positives_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return false;
+  }
+  RecordAccess(node);
+  fn(static_cast<const ValueType &>(node->value_));
+  rwlatch_.RUnLock();
+  return true;
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+template <typename Fn>
+void SKIPLIST_TYPE::ParallelForEach(const KeyType &begin, const KeyType &end, Fn &&fn, size_t threads) {
+  rwlatch_.RLock();
+  size_t first = RankOf(begin);
+  size_t last = RankOf(end);
+  ParallelScan(first, std::max(first, last), fn, threads);
+  rwlatch_.RUnLock();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+template <typename Fn>
+void SKIPLIST_TYPE::ParallelForEach(Fn &&fn, size_t threads) {
+  rwlatch_.RLock();
+  ParallelScan(0, size_, fn, threads);
+  rwlatch_.RUnLock();
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+template <typename Fn>
+void SKIPLIST_TYPE::ParallelScan(size_t first, size_t last, Fn &fn, size_t threads) {
+  // Slices shorter than this cost more to hand out than to scan.
+  const size_t min_slice = 1024;
+  size_t count = last - first;
+  threads = std::max<size_t>(1, std::min(threads, count / min_slice));
+  // bounds[i] is the first node of slice i; the last bound is the first node past the range (nullptr at the tail).
+  std::vector<SkipListNode *> bounds(threads + 1);
+  for (size_t i = 0; i <= threads; i++) {
+    bounds[i] = NodeAt(first + count * i / threads);
+  }
+  auto scan = [this, &bounds, &fn](size_t slice) {
+    for (auto p = bounds[slice]; p != bounds[slice + 1]; p = p->forward_[0]) {
+      if (!Expired(p)) {
+        fn(static_cast<const KeyType &>(p->key_), static_cast<const ValueType &>(p->value_));
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; i++) {
+    workers.emplace_back(scan, i);
+  }
+  scan(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+SKIPLIST_TEMPLATE_ARGUMENTS
+template <typename K, typename... Args>
+typename SKIPLIST_TYPE::SkipListNode *SKIPLIST_TYPE::CreateNode(int height, K &&key, Args &&... args) {
+  LOG_INFO("CreateNode with level: %d", height);
+  return new (AllocateNode(height)) SkipListNode(height, std::forward<K>(key), std::forward<Args>(args)...);
+}
+
 }  // namespace skiplist
@@ -0,0 +1,394 @@
+#include "sorted_run.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#ifdef SKIPLIST_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace skiplist {
+namespace {
+template <typename T>
+void Append(std::string *buffer, const T &value) {
+  buffer->append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+T Load(const char *data) {
+  T value;
+  memcpy(&value, data, sizeof(T));
+  return value;
+}
+}  // namespace
+
+////////////////// SortedRunWriter /////////////////
+template <typename KeyType, typename ValueType, typename KeyComparator>
+SORTED_RUN_WRITER_TYPE::SortedRunWriter(const std::string &file_name, const KeyComparator &comparator,
+                                        size_t block_size, size_t restart_interval, bool compress)
+    : output_(file_name, std::ios::binary | std::ios::trunc),
+      comparator_(comparator),
+      block_size_(block_size),
+      restart_interval_(std::max<size_t>(restart_interval, 1)),
+      compress_(compress) {
+  if (!output_) {
+    LOG_WARN("Can't open the file: %s", file_name.c_str());
+  }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool SORTED_RUN_WRITER_TYPE::Add(const KeyType &key, const ValueType &value) {
+  assert(entries_ == 0 || comparator_(last_key_, key) < 0);
+  if (!output_) {
+    return false;
+  }
+  const char *bytes = reinterpret_cast<const char *>(&key);
+  const char *last = reinterpret_cast<const char *>(&last_key_);
+  uint16_t shared = 0;
+  if (block_entries_ % restart_interval_ == 0) {
+    restarts_.push_back(block_.size());
+  } else {
+    while (shared < sizeof(KeyType) && bytes[shared] == last[shared]) {
+      shared++;
+    }
+  }
+  uint16_t unshared = sizeof(KeyType) - shared;
+  Append(&block_, shared);
+  Append(&block_, unshared);
+  block_.append(bytes + shared, unshared);
+  Append(&block_, value);
+  last_key_ = key;
+  block_entries_++;
+  entries_++;
+
+  if (block_.size() + sizeof(uint32_t) * (restarts_.size() + 1) >= block_size_) {
+    FlushBlock();
+  }
+  return static_cast<bool>(output_);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void SORTED_RUN_WRITER_TYPE::FlushBlock() {
+  if (block_entries_ == 0) {
+    return;
+  }
+  for (auto restart : restarts_) {
+    Append(&block_, restart);
+  }
+  Append(&block_, static_cast<uint32_t>(restarts_.size()));
+
+  auto type = BlockCompression::NONE;
+  std::string compressed;
+#ifdef SKIPLIST_HAVE_ZLIB
+  if (compress_) {
+    uLongf length = compressBound(block_.size());
+    compressed.resize(length);
+    if (compress2(reinterpret_cast<Bytef *>(&compressed[0]), &length, reinterpret_cast<const Bytef *>(block_.data()),
+                  block_.size(), Z_DEFAULT_COMPRESSION) == Z_OK &&
+        length < block_.size()) {
+      // Only keep the compressed form if it actually saves space.
+      compressed.resize(length);
+      type = BlockCompression::ZLIB;
+    }
+  }
+#endif
+  const std::string &payload = type == BlockCompression::NONE ? block_ : compressed;
+  output_.write(payload.data(), payload.size());
+  output_.put(static_cast<char>(type));
+  uint32_t raw_size = block_.size();
+  output_.write(reinterpret_cast<const char *>(&raw_size), sizeof(raw_size));
+
+  index_keys_.push_back(last_key_);
+  index_offsets_.push_back(offset_);
+  index_sizes_.push_back(payload.size());
+  offset_ += payload.size() + 1 + sizeof(raw_size);
+  block_.clear();
+  restarts_.clear();
+  block_entries_ = 0;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool SORTED_RUN_WRITER_TYPE::Finish() {
+  if (!output_) {
+    return false;
+  }
+  FlushBlock();
+  std::string tail;
+  for (size_t i = 0; i < index_keys_.size(); i++) {
+    Append(&tail, index_keys_[i]);
+    Append(&tail, index_offsets_[i]);
+    Append(&tail, index_sizes_[i]);
+  }
+  // footer
+  Append(&tail, offset_);
+  Append(&tail, static_cast<uint64_t>(index_keys_.size()));
+  Append(&tail, static_cast<uint64_t>(entries_));
+  Append(&tail, static_cast<uint32_t>(sizeof(KeyType)));
+  Append(&tail, static_cast<uint32_t>(sizeof(ValueType)));
+  Append(&tail, SortedRun<KeyType, ValueType, KeyComparator>::MAGIC);
+  output_.write(tail.data(), tail.size());
+  output_.close();
+  return !output_.fail();
+}
+
+////////////////// SortedRun /////////////////
+template <typename KeyType, typename ValueType, typename KeyComparator>
+std::unique_ptr<SORTED_RUN_TYPE> SORTED_RUN_TYPE::Open(const std::string &file_name, const KeyComparator &comparator) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG_WARN("Can't open the file: %s", file_name.c_str());
+    return nullptr;
+  }
+  std::unique_ptr<SortedRun> run(new SortedRun(fd, comparator));
+  if (!run->ReadFooterAndIndex()) {
+    LOG_WARN("%s is not a sorted run of this key and value type", file_name.c_str());
+    return nullptr;
+  }
+  LOG_INFO("Open sorted run %s with %lu entries in %lu blocks", file_name.c_str(), run->Size(), run->BlockCount());
+  return run;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool SORTED_RUN_TYPE::ReadFooterAndIndex() {
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size) < FOOTER_SIZE) {
+    return false;
+  }
+  file_size_ = st.st_size;
+  char footer[FOOTER_SIZE];
+  if (pread(fd_, footer, FOOTER_SIZE, file_size_ - FOOTER_SIZE) != static_cast<ssize_t>(FOOTER_SIZE)) {
+    return false;
+  }
+  auto index_offset = Load<uint64_t>(footer);
+  auto blocks = Load<uint64_t>(footer + 8);
+  entries_ = Load<uint64_t>(footer + 16);
+  const size_t entry_size = sizeof(KeyType) + 2 * sizeof(uint64_t);
+  if (Load<uint32_t>(footer + 24) != sizeof(KeyType) || Load<uint32_t>(footer + 28) != sizeof(ValueType) ||
+      Load<uint64_t>(footer + 32) != MAGIC || index_offset + blocks * entry_size + FOOTER_SIZE != file_size_) {
+    return false;
+  }
+
+  std::string index(blocks * entry_size, '\0');
+  if (pread(fd_, &index[0], index.size(), index_offset) != static_cast<ssize_t>(index.size())) {
+    return false;
+  }
+  index_keys_.resize(blocks);
+  index_offsets_.resize(blocks);
+  index_sizes_.resize(blocks);
+  for (size_t i = 0; i < blocks; i++) {
+    const char *p = index.data() + i * entry_size;
+    memcpy(&index_keys_[i], p, sizeof(KeyType));
+    index_offsets_[i] = Load<uint64_t>(p + sizeof(KeyType));
+    index_sizes_[i] = Load<uint64_t>(p + sizeof(KeyType) + sizeof(uint64_t));
+  }
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool SORTED_RUN_TYPE::ReadBlock(size_t index, Block *block) const {
+  size_t size = index_sizes_[index];
+  std::string buffer(size + BLOCK_TRAILER_SIZE, '\0');
+  if (pread(fd_, &buffer[0], buffer.size(), index_offsets_[index]) != static_cast<ssize_t>(buffer.size())) {
+    LOG_WARN("Short read of block %lu", index);
+    return false;
+  }
+  auto type = static_cast<BlockCompression>(buffer[size]);
+  auto raw_size = Load<uint32_t>(buffer.data() + size + 1);
+  if (type == BlockCompression::NONE) {
+    buffer.resize(size);
+    block->data_ = std::move(buffer);
+  } else if (type == BlockCompression::ZLIB) {
+#ifdef SKIPLIST_HAVE_ZLIB
+    block->data_.resize(raw_size);
+    uLongf length = raw_size;
+    if (uncompress(reinterpret_cast<Bytef *>(&block->data_[0]), &length, reinterpret_cast<const Bytef *>(buffer.data()),
+                   size) != Z_OK) {
+      LOG_WARN("Corrupted block %lu", index);
+      return false;
+    }
+#else
+    LOG_WARN("Block %lu is compressed but zlib support is not built in", index);
+    return false;
+#endif
+  } else {
+    LOG_WARN("Unknown compression type of block %lu", index);
+    return false;
+  }
+  if (block->data_.size() != raw_size || raw_size < sizeof(uint32_t)) {
+    LOG_WARN("Corrupted block %lu", index);
+    return false;
+  }
+  block->num_restarts_ = Load<uint32_t>(block->data_.data() + raw_size - sizeof(uint32_t));
+  if (block->num_restarts_ == 0 || (block->num_restarts_ + 1) * sizeof(uint32_t) > raw_size) {
+    LOG_WARN("Corrupted block %lu", index);
+    return false;
+  }
+  block->restarts_offset_ = raw_size - (block->num_restarts_ + 1) * sizeof(uint32_t);
+  // Entries are decoded straight from a restart point, so each one has to start inside the entries.
+  for (uint32_t i = 0; i < block->num_restarts_; i++) {
+    if (block->Restart(i) >= block->restarts_offset_ || (i == 0 && block->Restart(i) != 0)) {
+      LOG_WARN("Corrupted block %lu", index);
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+uint32_t SORTED_RUN_TYPE::Block::Restart(uint32_t i) const {
+  return Load<uint32_t>(data_.data() + restarts_offset_ + i * sizeof(uint32_t));
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+size_t SORTED_RUN_TYPE::DecodeEntry(const Block &block, size_t offset, KeyType *key, ValueType *value) {
+  if (offset + 2 * sizeof(uint16_t) > block.restarts_offset_) {
+    return 0;
+  }
+  const char *p = block.data_.data() + offset;
+  auto shared = Load<uint16_t>(p);
+  auto unshared = Load<uint16_t>(p + sizeof(uint16_t));
+  size_t next = offset + 2 * sizeof(uint16_t) + unshared + sizeof(ValueType);
+  if (shared + unshared != sizeof(KeyType) || next > block.restarts_offset_) {
+    return 0;
+  }
+  p += 2 * sizeof(uint16_t);
+  memcpy(reinterpret_cast<char *>(key) + shared, p, unshared);
+  memcpy(value, p + unshared, sizeof(ValueType));
+  return next;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+size_t SORTED_RUN_TYPE::FindBlock(const KeyType &key) const {
+  return std::lower_bound(index_keys_.begin(), index_keys_.end(), key,
+                          [this](const KeyType &last, const KeyType &target) { return comparator_(last, target) < 0; }) -
+         index_keys_.begin();
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool SORTED_RUN_TYPE::Lookup(const KeyType &key, std::vector<ValueType> *result) const {
+  size_t index = FindBlock(key);
+  Block block;
+  if (index == BlockCount() || !ReadBlock(index, &block)) {
+    return false;
+  }
+  // The last restart point whose key is <= key, then a short scan from there.
+  KeyType current;
+  ValueType value;
+  uint32_t left = 0;
+  uint32_t right = block.num_restarts_ - 1;
+  while (left < right) {
+    uint32_t mid = (left + right + 1) / 2;
+    if (DecodeEntry(block, block.Restart(mid), &current, &value) == 0) {
+      LOG_WARN("Corrupted entry in block %lu", index);
+      return false;
+    }
+    if (comparator_(current, key) <= 0) {
+      left = mid;
+    } else {
+      right = mid - 1;
+    }
+  }
+  for (size_t offset = block.Restart(left); offset < block.restarts_offset_;) {
+    offset = DecodeEntry(block, offset, &current, &value);
+    if (offset == 0) {
+      LOG_WARN("Corrupted entry in block %lu", index);
+      return false;
+    }
+    int cmp = comparator_(current, key);
+    if (cmp == 0) {
+      result->push_back(value);
+      return true;
+    }
+    if (cmp > 0) {
+      break;
+    }
+  }
+  return false;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+SORTED_RUN_TYPE::~SortedRun() {
+  close(fd_);
+}
+
+////////////////// Iterator /////////////////
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void SORTED_RUN_TYPE::Iterator::LoadBlock(size_t index) {
+  block_index_ = index;
+  if (index >= run_->BlockCount()) {
+    return;
+  }
+  if (!run_->ReadBlock(index, &block_)) {
+    // Stop here rather than skip entries.
+    block_index_ = run_->BlockCount();
+    return;
+  }
+  next_offset_ = DecodeEntry(block_, 0, &key_, &value_);
+  if (next_offset_ == 0) {
+    Corrupted();
+  }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void SORTED_RUN_TYPE::Iterator::Corrupted() {
+  LOG_WARN("Corrupted entry in block %lu", block_index_);
+  block_index_ = run_->BlockCount();
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void SORTED_RUN_TYPE::Iterator::SeekToFirst() {
+  LoadBlock(0);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void SORTED_RUN_TYPE::Iterator::Seek(const KeyType &key) {
+  LoadBlock(run_->FindBlock(key));
+  if (!Valid()) {
+    return;
+  }
+  uint32_t left = 0;
+  uint32_t right = block_.num_restarts_ - 1;
+  while (left < right) {
+    uint32_t mid = (left + right + 1) / 2;
+    if (DecodeEntry(block_, block_.Restart(mid), &key_, &value_) == 0) {
+      Corrupted();
+      return;
+    }
+    if (run_->comparator_(key_, key) <= 0) {
+      left = mid;
+    } else {
+      right = mid - 1;
+    }
+  }
+  next_offset_ = DecodeEntry(block_, block_.Restart(left), &key_, &value_);
+  if (next_offset_ == 0) {
+    Corrupted();
+    return;
+  }
+  // The block's last key is >= key, so this stops inside the block, unless the block turns out to be corrupted.
+  while (Valid() && run_->comparator_(key_, key) < 0) {
+    Next();
+  }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void SORTED_RUN_TYPE::Iterator::Next() {
+  assert(Valid());
+  if (next_offset_ >= block_.restarts_offset_) {
+    LoadBlock(block_index_ + 1);
+    return;
+  }
+  next_offset_ = DecodeEntry(block_, next_offset_, &key_, &value_);
+  if (next_offset_ == 0) {
+    Corrupted();
+  }
+}
+
+template class SortedRunWriter<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+template class SortedRun<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+}  // namespace skiplist
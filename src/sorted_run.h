@@ -0,0 +1,161 @@
+/**
+ * SortedRun: an immutable on-disk sorted run (SSTable) written from a sealed SkipList (see SkipList::Flush).
+ *
+ * File layout:
+ *   data block*  entries, then the restart offsets (uint32 each) and their count (uint32), then a one-byte
+ *                compression type and the uncompressed size (uint32)
+ *   index        last key, offset and on-disk size of every data block
+ *   footer       index offset, block count, entry count, key size, value size, magic
+ * An entry is <shared: uint16><unshared: uint16><key bytes [shared, sizeof(KeyType))><value bytes>, where shared is the
+ * length of the prefix it has in common with the previous key. Every restart_interval-th entry stores its whole key, so
+ * a lookup binary searches the restart points of one block and then scans at most restart_interval entries.
+ * Keys and values are stored as their raw bytes, so both must be trivially copyable.
+ * */
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "generic_key.h"
+#include "logger.h"
+
+namespace skiplist {
+
+#define SORTED_RUN_TYPE SortedRun<KeyType, ValueType, KeyComparator>
+#define SORTED_RUN_WRITER_TYPE SortedRunWriter<KeyType, ValueType, KeyComparator>
+
+// Block compression types, stored in the trailer of every data block.
+enum class BlockCompression : uint8_t { NONE = 0, ZLIB = 1 };
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class SortedRun;
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class SortedRunWriter {
+  static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                "keys and values are written as raw bytes");
+  static_assert(sizeof(KeyType) <= UINT16_MAX, "key lengths are stored as uint16");
+
+ public:
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 4096;
+  static constexpr size_t DEFAULT_RESTART_INTERVAL = 16;
+
+  // Compression is only applied when the library was built with zlib; otherwise blocks are stored as they are.
+  SortedRunWriter(const std::string &file_name, const KeyComparator &comparator, size_t block_size = DEFAULT_BLOCK_SIZE,
+                  size_t restart_interval = DEFAULT_RESTART_INTERVAL, bool compress = false);
+
+  // Keys must be added in strictly increasing order.
+  bool Add(const KeyType &key, const ValueType &value);
+  // Write the last block, the index and the footer. Nothing may be added afterwards.
+  bool Finish();
+
+  size_t Size() const { return entries_; }
+
+ private:
+  void FlushBlock();
+
+  std::ofstream output_;
+  KeyComparator comparator_;
+  size_t block_size_;
+  size_t restart_interval_;
+  bool compress_;
+  std::string block_;               // entries of the block being built
+  std::vector<uint32_t> restarts_;  // offsets of its full-key entries
+  size_t block_entries_{0};
+  KeyType last_key_;
+  uint64_t offset_{0};               // bytes written so far
+  std::vector<KeyType> index_keys_;  // last key of every block
+  std::vector<uint64_t> index_offsets_;
+  std::vector<uint64_t> index_sizes_;
+  size_t entries_{0};
+};
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class SortedRun {
+  static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                "keys and values are read as raw bytes");
+
+ public:
+  // Read the footer and the block index; data blocks stay on disk until a lookup or an iterator needs them.
+  // Returns nullptr if the file is missing or not a sorted run of this key and value type.
+  static std::unique_ptr<SortedRun> Open(const std::string &file_name, const KeyComparator &comparator);
+
+  bool Lookup(const KeyType &key, std::vector<ValueType> *result) const;
+
+  size_t Size() const { return entries_; }
+  size_t BlockCount() const { return index_keys_.size(); }
+  // Bytes of the file on disk.
+  size_t FileSize() const { return file_size_; }
+
+  ~SortedRun();
+
+ private:
+  friend class SortedRunWriter<KeyType, ValueType, KeyComparator>;
+
+  static constexpr uint64_t MAGIC = 0x736b69706c697374;  // "skiplist"
+  static constexpr size_t FOOTER_SIZE = 40;
+  static constexpr size_t BLOCK_TRAILER_SIZE = 5;  // compression type + uncompressed size
+
+  // One data block in memory, uncompressed.
+  struct Block {
+    std::string data_;
+    size_t restarts_offset_{0};  // end of the entries
+    uint32_t num_restarts_{0};
+
+    uint32_t Restart(uint32_t i) const;
+  };
+
+  SortedRun(int fd, const KeyComparator &comparator) : fd_(fd), comparator_(comparator) {}
+  bool ReadFooterAndIndex();
+  bool ReadBlock(size_t index, Block *block) const;
+  // Decode the entry at offset into key (whose first `shared` bytes already hold the previous key) and value.
+  // Returns the offset of the next entry, or 0 if the entry is malformed or runs past the entries.
+  static size_t DecodeEntry(const Block &block, size_t offset, KeyType *key, ValueType *value);
+  // First block whose last key is >= key, BlockCount() if there is none.
+  size_t FindBlock(const KeyType &key) const;
+
+  /************** Iterator Unit **********************/
+ public:
+  // Cursor over the run, reading one block at a time.
+  class Iterator {
+   public:
+    explicit Iterator(const SortedRun *run) : run_(run) {}
+
+    bool Valid() const { return block_index_ < run_->BlockCount(); }
+    void SeekToFirst();
+    // Position at the first key >= key.
+    void Seek(const KeyType &key);
+    void Next();
+    const KeyType &Key() const { return key_; }
+    const ValueType &Value() const { return value_; }
+
+   private:
+    void LoadBlock(size_t index);
+    // Stop at a malformed entry rather than skip or misread it.
+    void Corrupted();
+
+    const SortedRun *run_;
+    size_t block_index_{SIZE_MAX};
+    Block block_;
+    size_t next_offset_{0};  // of the entry after the current one
+    KeyType key_;
+    ValueType value_;
+  };
+
+  Iterator NewIterator() const { return Iterator(this); }
+
+ private:
+  int fd_;
+  KeyComparator comparator_;
+  size_t file_size_{0};
+  size_t entries_{0};
+  std::vector<KeyType> index_keys_;
+  std::vector<uint64_t> index_offsets_;
+  std::vector<uint64_t> index_sizes_;
+};
+
+}  // namespace skiplist
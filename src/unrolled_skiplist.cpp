@@ -0,0 +1,216 @@
+#include "unrolled_skiplist.h"
+
+#include <cstdlib>
+
+namespace skiplist {
+template <typename KeyType, typename ValueType, typename KeyComparator>
+UNROLLED_SKIPLIST_TYPE::UnrolledSkipList(const KeyComparator &comparator, size_t max_height, size_t branching,
+                                         size_t rnd)
+    : comparator_(comparator),
+      max_height_(max_height),
+      branching_(branching),
+      rnd_(rnd),
+      size_(0),
+      node_count_(0),
+      update_(max_height) {
+  LOG_INFO("Construct UnrolledSkipList with max_height: %lu and random seed: %lu", max_height, rnd);
+  srand(rnd_);
+  head_ = new UnrolledNode(max_height);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool UNROLLED_SKIPLIST_TYPE::Lookup(const KeyType &key, std::vector<ValueType> *result) {
+  rwlatch_.RLock();
+  LOG_INFO("Lookup: <%ld>", key.ToInteger());
+  auto cur = head_;
+  for (int level = max_height_ - 1; level >= 0; level--) {
+    auto p = cur->forward_[level];
+    while (p && comparator_(p->FirstKey(), key) <= 0) {
+      cur = p;
+      p = p->forward_[level];
+    }
+  }
+  if (cur != head_) {
+    size_t pos = NodeSearch<KeyType, KeyComparator>::LowerBound(comparator_, cur->keys_, cur->count_, key);
+    if (pos < cur->count_ && comparator_(cur->keys_[pos], key) == 0) {
+      result->push_back(cur->values_[pos]);
+      rwlatch_.RUnLock();
+      return true;
+    }
+  }
+  rwlatch_.RUnLock();
+  return false;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool UNROLLED_SKIPLIST_TYPE::Insert(const KeyType &key, const ValueType &value) {
+  rwlatch_.WLock();
+  auto node = FindNode(key);
+  if (node == head_) {
+    // Smaller than every key: it goes to the front of the first node.
+    node = head_->forward_[0];
+    if (node == nullptr) {
+      node = new UnrolledNode(RandomHeight());
+      LinkAfterUpdate(node);
+      node_count_++;
+    }
+    for (size_t level = 0; level < node->height_; level++) {
+      update_[level] = node;
+    }
+  }
+  size_t pos = NodeSearch<KeyType, KeyComparator>::LowerBound(comparator_, node->keys_, node->count_, key);
+  if (pos < node->count_ && comparator_(node->keys_[pos], key) == 0) {
+    LOG_WARN("The key: %lu has already existed!", key.ToInteger());
+    rwlatch_.WUnLock();
+    return false;
+  }
+
+  if (node->count_ == NODE_CAPACITY) {
+    // Move the upper half to a new sibling. Its predecessor at every level is node itself or update_[level].
+    auto sibling = new UnrolledNode(RandomHeight());
+    size_t half = NODE_CAPACITY / 2;
+    for (size_t i = half; i < NODE_CAPACITY; i++) {
+      sibling->keys_[i - half] = node->keys_[i];
+      sibling->values_[i - half] = node->values_[i];
+    }
+    sibling->count_ = NODE_CAPACITY - half;
+    node->count_ = half;
+    LinkAfterUpdate(sibling);
+    node_count_++;
+    if (pos > half) {
+      node = sibling;
+      pos -= half;
+    }
+  }
+  for (size_t i = node->count_; i > pos; i--) {
+    node->keys_[i] = node->keys_[i - 1];
+    node->values_[i] = node->values_[i - 1];
+  }
+  node->keys_[pos] = key;
+  node->values_[pos] = value;
+  node->count_++;
+  size_++;
+  rwlatch_.WUnLock();
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool UNROLLED_SKIPLIST_TYPE::Remove(const KeyType &key) {
+  rwlatch_.WLock();
+  LOG_INFO("Remove: %ld", key.ToInteger());
+  auto node = FindNode(key);
+  size_t pos = node == head_
+                   ? 0
+                   : NodeSearch<KeyType, KeyComparator>::LowerBound(comparator_, node->keys_, node->count_, key);
+  if (node == head_ || pos == node->count_ || comparator_(node->keys_[pos], key) != 0) {
+    LOG_WARN("The key is not exists.");
+    rwlatch_.WUnLock();
+    return false;
+  }
+  for (size_t i = pos + 1; i < node->count_; i++) {
+    node->keys_[i - 1] = node->keys_[i];
+    node->values_[i - 1] = node->values_[i];
+  }
+  node->count_--;
+  size_--;
+
+  if (node->count_ == 0) {
+    FindPredecessors(node);
+    Unlink(node);
+    delete node;
+    node_count_--;
+  } else if (node->count_ < NODE_CAPACITY / 4) {
+    auto next = node->forward_[0];
+    if (next != nullptr && node->count_ + next->count_ <= NODE_CAPACITY * 3 / 4) {
+      for (size_t i = 0; i < next->count_; i++) {
+        node->keys_[node->count_ + i] = next->keys_[i];
+        node->values_[node->count_ + i] = next->values_[i];
+      }
+      node->count_ += next->count_;
+      FindPredecessors(next);
+      Unlink(next);
+      delete next;
+      node_count_--;
+    }
+  }
+  rwlatch_.WUnLock();
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+typename UNROLLED_SKIPLIST_TYPE::UnrolledNode *UNROLLED_SKIPLIST_TYPE::FindNode(const KeyType &key) {
+  auto cur = head_;
+  for (int level = max_height_ - 1; level >= 0; level--) {
+    auto p = cur->forward_[level];
+    while (p && comparator_(p->FirstKey(), key) <= 0) {
+      cur = p;
+      p = p->forward_[level];
+    }
+    update_[level] = cur;
+  }
+  return cur;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void UNROLLED_SKIPLIST_TYPE::FindPredecessors(UnrolledNode *node) {
+  // An emptied node still holds its old first key, which keeps it ordered between its neighbours.
+  auto cur = head_;
+  for (int level = max_height_ - 1; level >= 0; level--) {
+    auto p = cur->forward_[level];
+    while (p && p != node && comparator_(p->FirstKey(), node->FirstKey()) < 0) {
+      cur = p;
+      p = p->forward_[level];
+    }
+    update_[level] = cur;
+  }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void UNROLLED_SKIPLIST_TYPE::LinkAfterUpdate(UnrolledNode *node) {
+  for (size_t level = 0; level < node->height_; level++) {
+    node->forward_[level] = update_[level]->forward_[level];
+    update_[level]->forward_[level] = node;
+  }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void UNROLLED_SKIPLIST_TYPE::Unlink(UnrolledNode *node) {
+  for (size_t level = 0; level < node->height_; level++) {
+    if (update_[level]->forward_[level] == node) {
+      update_[level]->forward_[level] = node->forward_[level];
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+size_t UNROLLED_SKIPLIST_TYPE::RandomHeight() {
+  // Increase height with probablility 1 in kBranching
+  size_t height = 1;
+  while (height < max_height_ && (size_t)rand() < (RAND_MAX / branching_)) {
+    height += 1;
+  }
+  return height;
+}
+
+////////////////// Iterator /////////////////
+template <typename KeyType, typename ValueType, typename KeyComparator>
+typename UNROLLED_SKIPLIST_TYPE::Iterator UNROLLED_SKIPLIST_TYPE::begin() {
+  return Iterator{head_->forward_[0], 0};
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+typename UNROLLED_SKIPLIST_TYPE::Iterator UNROLLED_SKIPLIST_TYPE::end() {
+  return Iterator{nullptr, 0};
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+UNROLLED_SKIPLIST_TYPE::~UnrolledSkipList() {
+  while (head_ != nullptr) {
+    auto node = head_;
+    head_ = head_->forward_[0];
+    delete node;
+  }
+}
+
+template class UnrolledSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+}  // namespace skiplist
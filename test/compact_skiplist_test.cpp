@@ -0,0 +1,281 @@
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "compact_skiplist.h"
+#include "generic_key.h"
+#include "gtest/gtest.h"
+
+namespace skiplist {
+using TestList = CompactSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+
+// Walk level 0 and check it against Size() and against lookups, which go through the upper levels.
+static void CheckList(TestList *skiplist, std::set<int64_t> *keys) {
+  keys->clear();
+  std::vector<GenericValue<8>> result;
+  GenericKey<8> index_key;
+  for (auto iter : *skiplist) {
+    int64_t key = iter.first.ToInteger();
+    EXPECT_EQ(iter.second.ToInteger(), key);
+    if (!keys->empty()) {
+      EXPECT_LT(*keys->rbegin(), key);
+    }
+    keys->insert(key);
+  }
+  EXPECT_EQ(skiplist->Size(), keys->size());
+  for (auto key : *keys) {
+    result.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_EQ(true, skiplist->Lookup(index_key, &result));
+  }
+}
+
+TEST(CompactSkipListTest, EmptyTest) {
+  GenericComparator<8> comparator;
+  CompactSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, 5);
+  EXPECT_EQ(skiplist.Size(), 0);
+  std::vector<GenericValue<8>> result;
+  GenericKey<8> index_key;
+  index_key.SetFromInteger(0);
+  EXPECT_EQ(false, skiplist.Lookup(index_key, &result));
+  EXPECT_EQ(false, skiplist.Remove(index_key));
+  EXPECT_EQ(skiplist.begin(), skiplist.end());
+}
+
+TEST(CompactSkipListTest, MixTest) {
+  GenericComparator<8> comparator;
+  CompactSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, 16);
+
+  // enough nodes to outgrow the initial mapping several times over
+  int scale_keys = 200000;
+  std::vector<int64_t> keys;
+  for (int i = 0; i < scale_keys; i++) {
+    keys.push_back(i * 3);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xdeadbeef));
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  for (auto key : keys) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key);
+    EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+  }
+  EXPECT_EQ(false, skiplist.Insert(index_key, index_value));
+  EXPECT_EQ(skiplist.Size(), scale_keys);
+  EXPECT_GT(skiplist.ApproximateMemoryUsage(), OffsetArena::DEFAULT_CAPACITY);
+
+  std::set<int64_t> alive(keys.begin(), keys.end());
+  for (int i = 0; i < scale_keys; i += 2) {
+    index_key.SetFromInteger(keys[i]);
+    EXPECT_EQ(true, skiplist.Remove(index_key));
+    alive.erase(keys[i]);
+  }
+  std::vector<GenericValue<8>> result;
+  for (int64_t key = -1; key < 3 * scale_keys; key++) {
+    result.clear();
+    index_key.SetFromInteger(key);
+    bool present = alive.count(key) != 0;
+    EXPECT_EQ(present, skiplist.Lookup(index_key, &result));
+    if (present) {
+      EXPECT_EQ(result[0].ToInteger(), key);
+    }
+  }
+  auto expected = alive.begin();
+  for (auto iter : skiplist) {
+    ASSERT_NE(expected, alive.end());
+    EXPECT_EQ(iter.first.ToInteger(), *expected);
+    EXPECT_EQ(iter.second.ToInteger(), *expected);
+    ++expected;
+  }
+  EXPECT_EQ(expected, alive.end());
+
+  // removed slots are reused before the arena grows again
+  size_t memory = skiplist.ApproximateMemoryUsage();
+  for (int i = 0; i < scale_keys; i += 2) {
+    index_key.SetFromInteger(keys[i]);
+    index_value.SetFromInteger(keys[i]);
+    EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+  }
+  EXPECT_LT(skiplist.ApproximateMemoryUsage(), memory * 11 / 10);
+  EXPECT_EQ(skiplist.Size(), scale_keys);
+}
+
+TEST(CompactSkipListTest, ReopenTest) {
+  GenericComparator<8> comparator;
+  std::string file_name = "compact_skiplist_reopen.db";
+  std::remove(file_name.c_str());
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  std::set<int64_t> alive;
+  {
+    // without sync for speed: a clean close is all that this test needs
+    auto skiplist = TestList::Open(file_name, comparator, 12, 2, false);
+    ASSERT_NE(skiplist, nullptr);
+    EXPECT_EQ(skiplist->Size(), 0);
+    // the file is locked while it is open
+    EXPECT_EQ(TestList::Open(file_name, comparator), nullptr);
+    for (int64_t key = 0; key < 100000; key++) {
+      index_key.SetFromInteger(key * 7 % 100000);
+      index_value.SetFromInteger(key * 7 % 100000);
+      EXPECT_EQ(true, skiplist->Insert(index_key, index_value));
+    }
+    for (int64_t key = 0; key < 100000; key += 3) {
+      index_key.SetFromInteger(key);
+      EXPECT_EQ(true, skiplist->Remove(index_key));
+    }
+  }
+  // a file that holds something else is refused, not misread
+  std::string other_name = "compact_skiplist_other.db";
+  FILE *other = std::fopen(other_name.c_str(), "w");
+  std::fputs("not a skiplist", other);
+  std::fclose(other);
+  EXPECT_EQ(TestList::Open(other_name, comparator), nullptr);
+  std::remove(other_name.c_str());
+
+  // the list comes back with its own max_height, and keeps working, now syncing every step
+  auto skiplist = TestList::Open(file_name, comparator, 3);
+  ASSERT_NE(skiplist, nullptr);
+  CheckList(skiplist.get(), &alive);
+  EXPECT_EQ(alive.size(), 100000 - 33334);
+  EXPECT_EQ(alive.count(3), 0);
+  EXPECT_EQ(alive.count(4), 1);
+  size_t memory = skiplist->ApproximateMemoryUsage();
+  for (int64_t key = 0; key < 3000; key += 3) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key);
+    EXPECT_EQ(true, skiplist->Insert(index_key, index_value));
+  }
+  EXPECT_LT(skiplist->ApproximateMemoryUsage(), memory * 101 / 100);
+  CheckList(skiplist.get(), &alive);
+  EXPECT_EQ(alive.size(), 100000 - 33334 + 1000);
+  skiplist.reset();
+  std::remove(file_name.c_str());
+}
+
+TEST(CompactSkipListTest, CrashTest) {
+  GenericComparator<8> comparator;
+  std::string file_name = "compact_skiplist_crash.db";
+  std::remove(file_name.c_str());
+  std::mt19937 rnd(0xdeadbeef);
+  std::set<int64_t> alive;
+  for (int round = 0; round < 20; round++) {
+    unsigned seed = rnd();
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+      // Insert and remove at random until killed. With sync most of the time goes to msync() between two steps of
+      // an operation, so the kill mostly lands in the middle of one.
+      auto skiplist = TestList::Open(file_name, comparator, 12);
+      if (skiplist == nullptr) {
+        _exit(1);
+      }
+      std::mt19937 child_rnd(seed);
+      GenericKey<8> index_key;
+      GenericValue<8> index_value;
+      std::vector<GenericValue<8>> result;
+      while (true) {
+        int64_t key = child_rnd() % 20000;
+        index_key.SetFromInteger(key);
+        index_value.SetFromInteger(key);
+        result.clear();
+        if (skiplist->Lookup(index_key, &result)) {
+          skiplist->Remove(index_key);
+        } else {
+          skiplist->Insert(index_key, index_value);
+        }
+      }
+    }
+    usleep(20000 + rnd() % 30000);
+    kill(pid, SIGKILL);
+    int status;
+    waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFSIGNALED(status));
+
+    auto skiplist = TestList::Open(file_name, comparator);
+    ASSERT_NE(skiplist, nullptr);
+    size_t before = alive.size();
+    CheckList(skiplist.get(), &alive);
+    if (round == 0) {
+      EXPECT_GT(alive.size(), before);
+    }
+  }
+  std::remove(file_name.c_str());
+}
+
+// Every insert of the child takes a node off a free list. After each crash the free lists must still only hold
+// removed nodes: inserts that drain them may not clobber live entries.
+TEST(CompactSkipListTest, CrashReuseTest) {
+  GenericComparator<8> comparator;
+  std::string file_name = "compact_skiplist_crash_reuse.db";
+  std::remove(file_name.c_str());
+  std::mt19937 rnd(0xbeefdead);
+  std::set<int64_t> alive;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  {
+    auto skiplist = TestList::Open(file_name, comparator, 12, 2, false);
+    ASSERT_NE(skiplist, nullptr);
+    for (int64_t key = 0; key < 2000; key++) {
+      index_key.SetFromInteger(key);
+      index_value.SetFromInteger(key);
+      skiplist->Insert(index_key, index_value);
+    }
+  }
+  for (int round = 0; round < 10; round++) {
+    unsigned seed = rnd();
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+      // Remove a key and put it straight back, so the node it gets is one that was just freed.
+      auto skiplist = TestList::Open(file_name, comparator);
+      if (skiplist == nullptr) {
+        _exit(1);
+      }
+      std::mt19937 child_rnd(seed);
+      while (true) {
+        int64_t key = child_rnd() % 2000;
+        index_key.SetFromInteger(key);
+        index_value.SetFromInteger(key);
+        skiplist->Remove(index_key);
+        skiplist->Insert(index_key, index_value);
+      }
+    }
+    usleep(20000 + rnd() % 30000);
+    kill(pid, SIGKILL);
+    int status;
+    waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFSIGNALED(status));
+
+    // the checks need no msync
+    auto skiplist = TestList::Open(file_name, comparator, 12, 2, false);
+    ASSERT_NE(skiplist, nullptr);
+    CheckList(skiplist.get(), &alive);
+    // at most the key in flight is missing
+    EXPECT_GE(alive.size(), 1999);
+    for (int64_t key = 0; key < 2000; key++) {
+      index_key.SetFromInteger(key);
+      index_value.SetFromInteger(key);
+      skiplist->Insert(index_key, index_value);
+    }
+    // drain the free lists into fresh keys, then check nothing live was reused
+    for (int64_t key = 2000; key < 4000; key++) {
+      index_key.SetFromInteger(key);
+      index_value.SetFromInteger(key);
+      skiplist->Insert(index_key, index_value);
+    }
+    CheckList(skiplist.get(), &alive);
+    EXPECT_EQ(4000, alive.size());
+    for (int64_t key = 2000; key < 4000; key++) {
+      index_key.SetFromInteger(key);
+      skiplist->Remove(index_key);
+    }
+  }
+  std::remove(file_name.c_str());
+}
+}  // namespace skiplist
@@ -0,0 +1,60 @@
+#include <vector>
+
+#include "generic_key.h"
+#include "gtest/gtest.h"
+#include "skiplist.h"
+
+namespace skiplist {
+TEST(FrozenSkipListTest, EmptyTest) {
+  GenericComparator<8> comparator;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, 5);
+  auto frozen = skiplist.Freeze();
+  EXPECT_EQ(frozen->Size(), 0);
+  EXPECT_EQ(frozen->begin(), frozen->end());
+  std::vector<GenericValue<8>> result;
+  GenericKey<8> index_key;
+  index_key.SetFromInteger(0);
+  EXPECT_EQ(false, frozen->Lookup(index_key, &result));
+}
+
+TEST(FrozenSkipListTest, LookupTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  // odd keys only, so every even key is a miss that falls between two stored keys
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  int scale_keys = 1000;
+  for (int i = 0; i < scale_keys; i++) {
+    index_key.SetFromInteger(2 * i + 1);
+    index_value.SetFromInteger(-(2 * i + 1));
+    skiplist.Insert(index_key, index_value);
+  }
+  auto frozen = skiplist.Freeze();
+  skiplist.Clear();
+  EXPECT_EQ(frozen->Size(), scale_keys);
+
+  std::vector<GenericValue<8>> result;
+  for (int i = 0; i <= 2 * scale_keys + 1; i++) {
+    index_key.SetFromInteger(i);
+    result.clear();
+    if (i % 2 == 1 && i < 2 * scale_keys) {
+      EXPECT_EQ(true, frozen->Lookup(index_key, &result));
+      EXPECT_EQ(result.size(), 1);
+      EXPECT_EQ(result[0].ToInteger(), -i);
+    } else {
+      EXPECT_EQ(false, frozen->Lookup(index_key, &result));
+      EXPECT_EQ(result.size(), 0);
+    }
+  }
+
+  int i = 0;
+  for (auto iter : *frozen) {
+    EXPECT_EQ(iter.first.ToInteger(), 2 * i + 1);
+    EXPECT_EQ(iter.second.ToInteger(), -(2 * i + 1));
+    i++;
+  }
+  EXPECT_EQ(i, scale_keys);
+}
+}  // namespace skiplist
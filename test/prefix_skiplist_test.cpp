@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "generic_key.h"
+#include "gtest/gtest.h"
+#include "prefix_skiplist.h"
+
+namespace skiplist {
+TEST(PrefixSkipListTest, EmptyTest) {
+  GenericComparator<32> comparator;
+  PrefixSkipList<GenericKey<32>, GenericValue<8>, GenericComparator<32>> skiplist(comparator, 5);
+  EXPECT_EQ(skiplist.Size(), 0);
+  std::vector<GenericValue<8>> result;
+  GenericKey<32> index_key;
+  index_key.SetFromInteger(0);
+  EXPECT_EQ(false, skiplist.Lookup(index_key, &result));
+  EXPECT_EQ(false, skiplist.Remove(index_key));
+  EXPECT_EQ(skiplist.begin(), skiplist.end());
+  // the all-zero key equals the implicit key of the head and must still round-trip
+  GenericValue<8> index_value;
+  index_value.SetFromInteger(7);
+  EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+  EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+  EXPECT_EQ(result[0].ToInteger(), 7);
+  EXPECT_EQ(false, skiplist.Insert(index_key, index_value));
+}
+
+TEST(PrefixSkipListTest, MixTest) {
+  GenericComparator<64> comparator;
+  PrefixSkipList<GenericKey<64>, GenericValue<8>, GenericComparator<64>> skiplist(comparator, 10);
+
+  // random order, so successors get re-encoded both ways
+  int scale_keys = 20000;
+  std::vector<int64_t> keys;
+  for (int i = 0; i < scale_keys; i++) {
+    keys.push_back(i * 7 - scale_keys);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xdeadbeef));
+  GenericKey<64> index_key;
+  GenericValue<8> index_value;
+  for (auto key : keys) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key);
+    EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+  }
+  EXPECT_EQ(skiplist.Size(), scale_keys);
+
+  // drop every third key, then check the survivors through lookups and a full scan
+  std::set<int64_t> alive(keys.begin(), keys.end());
+  for (int i = 0; i < scale_keys; i += 3) {
+    index_key.SetFromInteger(keys[i]);
+    EXPECT_EQ(true, skiplist.Remove(index_key));
+    EXPECT_EQ(false, skiplist.Remove(index_key));
+    alive.erase(keys[i]);
+  }
+  EXPECT_EQ(skiplist.Size(), alive.size());
+  std::vector<GenericValue<8>> result;
+  for (int64_t key = -scale_keys - 1; key < 6 * scale_keys; key++) {
+    result.clear();
+    index_key.SetFromInteger(key);
+    bool present = alive.count(key) != 0;
+    EXPECT_EQ(present, skiplist.Lookup(index_key, &result));
+    if (present) {
+      EXPECT_EQ(result[0].ToInteger(), key);
+    }
+  }
+  auto expected = alive.begin();
+  for (auto iter : skiplist) {
+    ASSERT_NE(expected, alive.end());
+    EXPECT_EQ(iter.first.ToInteger(), *expected);
+    EXPECT_EQ(iter.second.ToInteger(), *expected);
+    ++expected;
+  }
+  EXPECT_EQ(expected, alive.end());
+}
+
+TEST(PrefixSkipListTest, KeyBytesTest) {
+  GenericComparator<32> comparator;
+  PrefixSkipList<GenericKey<32>, GenericValue<8>, GenericComparator<32>> skiplist(comparator, 12);
+  int scale_keys = 100000;
+  GenericKey<32> index_key;
+  GenericValue<8> index_value;
+  for (int i = 0; i < scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    skiplist.Insert(index_key, index_value);
+  }
+  // with branching 4, about a quarter of the keys are towers stored in full; the rest shrink to a byte or two
+  size_t full_bytes = sizeof(GenericKey<32>) * skiplist.Size();
+  EXPECT_LT(skiplist.KeyBytes(), full_bytes / 3);
+  EXPECT_LT(skiplist.ApproximateMemoryUsage(), full_bytes + sizeof(GenericValue<8>) * 3 * skiplist.Size());
+
+  for (int i = 0; i < scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    skiplist.Remove(index_key);
+  }
+  EXPECT_EQ(skiplist.KeyBytes(), 0);
+}
+}  // namespace skiplist
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <thread>  //NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "rwlatch.h"
+
+namespace skiplist {
+template <typename... Args>
+void LaunchParallelTest(int num_threads, Args &&... args) {
+  std::vector<std::thread> thread_pool;
+  for (int thread_iter = 0; thread_iter < num_threads; thread_iter++) {
+    thread_pool.push_back(std::thread(args..., thread_iter));
+  }
+  for (auto &t : thread_pool) {
+    t.join();
+  }
+}
+
+// Writers keep two counters equal, readers must never see them apart.
+void MixedHelper(ReaderWriterLatch *latch, int64_t *first, int64_t *second, int rounds, int thread_iter) {
+  for (int i = 0; i < rounds; i++) {
+    if ((i + thread_iter) % 4 == 0) {
+      latch->WLock();
+      (*first)++;
+      (*second)++;
+      latch->WUnLock();
+    } else {
+      latch->RLock();
+      EXPECT_EQ(*first, *second);
+      latch->RUnLock();
+    }
+  }
+}
+
+TEST(ReaderWriterLatchTest, WriterPreferenceTest) {
+  ReaderWriterLatch latch;
+  int64_t first = 0;
+  int64_t second = 0;
+  int rounds = 100000;
+  int thread_num = 4;
+  LaunchParallelTest(thread_num, MixedHelper, &latch, &first, &second, rounds);
+  EXPECT_EQ(first, thread_num * rounds / 4);
+  EXPECT_EQ(first, second);
+}
+
+TEST(ReaderWriterLatchTest, ReaderPreferenceTest) {
+  ReaderWriterLatch latch(ReaderWriterLatch::Preference::READER);
+  int64_t first = 0;
+  int64_t second = 0;
+  int rounds = 100000;
+  int thread_num = 4;
+  LaunchParallelTest(thread_num, MixedHelper, &latch, &first, &second, rounds);
+  EXPECT_EQ(first, thread_num * rounds / 4);
+  EXPECT_EQ(first, second);
+}
+
+// Cost of one acquire/release pair without and with other threads on the latch
+TEST(ReaderWriterLatchTest, PerformanceTest) {
+  ReaderWriterLatch latch;
+  int rounds = 1000000;
+  int64_t first = 0;
+  int64_t second = 0;
+
+  auto start_time = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    latch.RLock();
+    latch.RUnLock();
+  }
+  auto read_time = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    latch.WLock();
+    latch.WUnLock();
+  }
+  auto write_time = std::chrono::high_resolution_clock::now();
+  int thread_num = 4;
+  LaunchParallelTest(thread_num, MixedHelper, &latch, &first, &second, rounds);
+  auto mixed_time = std::chrono::high_resolution_clock::now();
+
+  auto nanos = [](std::chrono::high_resolution_clock::duration span) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(span).count();
+  };
+  std::cout << "\n--------------- Latch Acquire Cost --------------------" << std::endl;
+  std::cout << "Uncontended RLock/RUnLock: " << (float)nanos(read_time - start_time) / rounds << " ns" << std::endl
+            << "Uncontended WLock/WUnLock: " << (float)nanos(write_time - read_time) / rounds << " ns" << std::endl
+            << "Contended (" << thread_num << " threads, 1/4 writes): "
+            << (float)nanos(mixed_time - write_time) / (rounds * thread_num) << " ns" << std::endl;
+}
+}  // namespace skiplist
@@ -0,0 +1,125 @@
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "coroutine.h"
+#include "generic_key.h"
+#include "gtest/gtest.h"
+#include "skiplist.h"
+
+namespace skiplist {
+#ifdef __cpp_impl_coroutine
+using TestList = SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+
+// Look up every thread_num-th key of [0, scale_keys) starting at thread_iter; only even keys are present.
+Task<void> LookupTask(TestList *skiplist, int scale_keys, int thread_num, int thread_iter, int *found) {
+  GenericKey<8> index_key;
+  std::vector<GenericValue<8>> result;
+  for (int i = thread_iter; i < scale_keys; i += thread_num) {
+    result.clear();
+    index_key.SetFromInteger(i);
+    bool hit = co_await skiplist->LookupAsync(index_key, &result);
+    EXPECT_EQ(hit, i % 2 == 0);
+    if (hit) {
+      EXPECT_EQ(result[0].ToInteger(), i);
+      (*found)++;
+    }
+  }
+}
+
+// Record whether the other tasks are all blocked, before and after blocking once.
+Task<void> BlockTask(InterleavedExecutor *executor, std::vector<bool> *others_blocked) {
+  others_blocked->push_back(executor->OthersBlocked());
+  co_await executor->Block();
+  others_blocked->push_back(executor->OthersBlocked());
+}
+
+TEST(SkipListAsyncTest, BlockedTaskTest) {
+  InterleavedExecutor executor;
+  std::vector<bool> others_blocked;
+  executor.Spawn(BlockTask(&executor, &others_blocked));
+  executor.Spawn(BlockTask(&executor, &others_blocked));
+  executor.Run();
+  // the first task starts with the second still to run; from then on the other one is always blocked
+  EXPECT_EQ(others_blocked, std::vector<bool>({false, true, true, true}));
+}
+
+TEST(SkipListAsyncTest, InterleavedLookupTest) {
+  GenericComparator<8> comparator;
+  TestList skiplist(comparator, 12);
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  int scale_keys = 10000;
+  for (int i = 0; i < scale_keys; i += 2) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    skiplist.Insert(index_key, index_value);
+  }
+
+  for (int in_flight : {1, 16}) {
+    InterleavedExecutor executor;
+    int found = 0;
+    for (int t = 0; t < in_flight; t++) {
+      executor.Spawn(LookupTask(&skiplist, scale_keys, in_flight, t, &found));
+    }
+    executor.Run();
+    EXPECT_EQ(found, scale_keys / 2);
+  }
+  EXPECT_EQ(InterleavedExecutor::Current(), nullptr);
+}
+
+// Misses the filter lets through count as its false positives, as they do for Lookup
+TEST(SkipListAsyncTest, FilterFalsePositiveTest) {
+  GenericComparator<8> comparator;
+  TestList skiplist(comparator, 12);
+  // one cell per key lets many odd keys past the filter
+  skiplist.EnableFilter(100, 1);
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  int scale_keys = 2000;
+  for (int i = 0; i < scale_keys; i += 2) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    skiplist.Insert(index_key, index_value);
+  }
+  InterleavedExecutor executor;
+  int found = 0;
+  executor.Spawn(LookupTask(&skiplist, scale_keys, 1, 0, &found));
+  executor.Run();
+  EXPECT_EQ(found, scale_keys / 2);
+  EXPECT_GT(skiplist.FilterFalsePositiveRate(), 0);
+}
+
+// Interleaved readers wait for writers by yielding, never by blocking their thread
+TEST(SkipListAsyncTest, WriterContentionTest) {
+  GenericComparator<8> comparator;
+  TestList skiplist(comparator, 12);
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  int scale_keys = 20000;
+  for (int i = 0; i < scale_keys; i += 2) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    skiplist.Insert(index_key, index_value);
+  }
+  // the writer only adds keys beyond the looked-up range
+  std::thread writer([&skiplist, scale_keys]() {
+    GenericKey<8> key;
+    GenericValue<8> value;
+    for (int i = scale_keys; i < 2 * scale_keys; i++) {
+      key.SetFromInteger(i);
+      value.SetFromInteger(i);
+      skiplist.Insert(key, value);
+    }
+  });
+  InterleavedExecutor executor;
+  int found = 0;
+  for (int t = 0; t < 8; t++) {
+    executor.Spawn(LookupTask(&skiplist, scale_keys, 8, t, &found));
+  }
+  executor.Run();
+  writer.join();
+  EXPECT_EQ(found, scale_keys / 2);
+  EXPECT_EQ(skiplist.Size(), scale_keys / 2 + scale_keys);
+}
+#endif
+}  // namespace skiplist
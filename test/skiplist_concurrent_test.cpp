@@ -1,4 +1,6 @@
+#include <atomic>
 #include <functional>
+#include <map>
 #include <mutex>   //NOLINT
 #include <thread>  //NOLINT
 #include <vector>
@@ -281,4 +283,157 @@ TEST(SkipListTest, MixTest2) {
   }
 }
 
-}  // namespace skiplist
\ No newline at end of file
+
+TEST(SkipListTest, FlatCombiningTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  skiplist.SetFlatCombining(true);
+
+  int scale_keys = 100000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+
+  int thread_num = 4;
+  LaunchParallelTest(thread_num, InsertSplitHelper, &skiplist, keys, thread_num);
+  int i = 0;
+  for (auto iter : skiplist) {
+    EXPECT_EQ(iter.first.ToInteger(), keys[i++]);
+  }
+  EXPECT_EQ(skiplist.Size(), keys.size());
+  // every position is still reachable through the spans kept by the combiner
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  for (i = 0; i < scale_keys; i += 1000) {
+    EXPECT_EQ(true, skiplist.Select(i, &index_key, &index_value));
+    EXPECT_EQ(index_key.ToInteger(), keys[i]);
+  }
+
+  LaunchParallelTest(thread_num, LookupHelper, &skiplist, keys);
+  LaunchParallelTest(thread_num, DeleteSplitHelper, &skiplist, keys, thread_num);
+  EXPECT_EQ(skiplist.Size(), 0);
+}
+
+TEST(SkipListTest, ChangeFeedTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  skiplist.EnableChangeFeed(1 << 18);
+  auto subscriber = skiplist.Subscribe();
+
+  int scale_keys = 100000;
+  std::vector<int64_t> keys;
+  std::vector<int64_t> odd_keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+    if (i % 2 == 1) {
+      odd_keys.push_back(i);
+    }
+  }
+
+  // a mirror kept up to date while the writers run
+  std::atomic<bool> done{false};
+  std::map<int64_t, int64_t> mirror;
+  uint64_t expected_seq = 0;
+  auto consume = [&]() {
+    std::vector<ChangeRecord<GenericKey<8>, GenericValue<8>>> batch;
+    subscriber->Poll(&batch, 1024);
+    for (const auto &record : batch) {
+      EXPECT_EQ(expected_seq++, record.seq_);
+      if (record.op_ == ChangeOp::INSERT) {
+        mirror[record.key_.ToInteger()] = record.value_.ToInteger();
+      } else {
+        EXPECT_EQ(1, mirror.erase(record.key_.ToInteger()));
+      }
+    }
+    return !batch.empty();
+  };
+  std::thread consumer([&]() {
+    while (!done.load()) {
+      consume();
+    }
+  });
+  int thread_num = 4;
+  LaunchParallelTest(thread_num, InsertSplitHelper, &skiplist, keys, thread_num);
+  LaunchParallelTest(thread_num, DeleteSplitHelper, &skiplist, odd_keys, thread_num);
+  done.store(true);
+  consumer.join();
+  while (consume()) {
+  }
+
+  EXPECT_EQ(0, subscriber->Lag());
+  EXPECT_EQ(0, subscriber->Dropped());
+  EXPECT_EQ(false, subscriber->Overflowed());
+  EXPECT_EQ(skiplist.Size(), mirror.size());
+  auto it = mirror.begin();
+  for (auto iter : skiplist) {
+    EXPECT_EQ(iter.first.ToInteger(), it->first);
+    EXPECT_EQ(iter.second.ToInteger(), it->second);
+    ++it;
+  }
+}
+
+TEST(SkipListTest, ParallelForEachTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  int scale_keys = 100000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  InsertHelper(&skiplist, keys);
+
+  // every key of the range is visited exactly once, whatever the slicing
+  for (size_t threads : {1, 3, 8}) {
+    std::vector<std::atomic<int>> visits(scale_keys + 1);
+    skiplist.ParallelForEach(
+        [&visits](const GenericKey<8> &key, const GenericValue<8> &value) {
+          EXPECT_EQ(key.ToInteger(), value.ToInteger());
+          visits[key.ToInteger()]++;
+        },
+        threads);
+    for (int i = 1; i <= scale_keys; i++) {
+      EXPECT_EQ(visits[i].load(), 1);
+    }
+
+    GenericKey<8> begin;
+    GenericKey<8> end;
+    begin.SetFromInteger(12345);
+    end.SetFromInteger(87654);
+    std::atomic<int64_t> sum{0};
+    std::atomic<int> count{0};
+    skiplist.ParallelForEach(
+        begin, end,
+        [&sum, &count](const GenericKey<8> &key, const GenericValue<8> &value) {
+          sum += key.ToInteger();
+          count++;
+        },
+        threads);
+    EXPECT_EQ(count.load(), 87654 - 12345);
+    EXPECT_EQ(sum.load(), (int64_t)(12345 + 87653) * (87654 - 12345) / 2);
+  }
+
+  // writers wait for the whole scan, so it sees either none or all of a batch
+  std::thread writer([&skiplist, scale_keys]() {
+    GenericKey<8> key;
+    GenericValue<8> value;
+    for (int i = scale_keys + 1; i <= 2 * scale_keys; i++) {
+      key.SetFromInteger(i);
+      value.SetFromInteger(i);
+      skiplist.Insert(key, value);
+    }
+  });
+  for (int round = 0; round < 10; round++) {
+    std::atomic<int> count{0};
+    skiplist.ParallelForEach([&count](const GenericKey<8> &key, const GenericValue<8> &value) { count++; }, 4);
+    EXPECT_GE(count.load(), scale_keys);
+    EXPECT_LE(count.load(), 2 * scale_keys);
+  }
+  writer.join();
+  EXPECT_EQ(skiplist.Size(), 2 * scale_keys);
+}
+}  // namespace skiplist
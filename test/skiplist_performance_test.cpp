@@ -2,14 +2,104 @@
  * Author: fhkong
  * Time: 2022.05.09
  * **/
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
 #include <thread>
 #include <vector>
 
+#include "compact_skiplist.h"
+#include "coroutine.h"
 #include "gtest/gtest.h"
+#include "prefix_skiplist.h"
 #include "skiplist.h"
+#include "unrolled_skiplist.h"
 
 namespace skiplist {
+// Counts user-space dTLB load misses of the calling thread through perf_event_open. Valid() is false where the
+// kernel or the hypervisor does not expose the counter.
+class DTLBMissCounter {
+ public:
+  DTLBMissCounter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  ~DTLBMissCounter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  bool Valid() const { return fd_ >= 0; }
+  void Start() {
+    ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  uint64_t Stop() {
+    ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t count = 0;
+    if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+      return 0;
+    }
+    return count;
+  }
+
+ private:
+  int fd_;
+};
+
+// Zipf(theta) ranks in [0, n), rank 0 being the most frequent; after Gray et al., "Quickly Generating Billion-Record
+// Synthetic Databases", as used by YCSB.
+class ZipfGenerator {
+ public:
+  ZipfGenerator(uint64_t n, double theta, uint64_t seed) : n_(n), theta_(theta), rng_(seed) {
+    for (uint64_t i = 1; i <= n; i++) {
+      zetan_ += 1.0 / std::pow(static_cast<double>(i), theta);
+    }
+    double zeta2 = 1.0 + std::pow(0.5, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+  }
+
+  uint64_t Next() {
+    double u = uniform_(rng_);
+    double uz = u * zetan_;
+    if (uz < 1.0) {
+      return 0;
+    }
+    if (uz < 1.0 + std::pow(0.5, theta_)) {
+      return 1;
+    }
+    return std::min<uint64_t>(n_ - 1, n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+  }
+
+ private:
+  uint64_t n_;
+  double theta_;
+  double zetan_{0};
+  double alpha_;
+  double eta_;
+  std::mt19937_64 rng_;
+  std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+};
+
 template <typename... Args>
 void LuanchParallelTest(int thread_num, Args &&... args) {
   std::vector<std::thread> thread_pool;
@@ -122,6 +212,32 @@ TEST(PerformanceTest, InsertTest2) {
             << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl;
 }
 
+// insert 100w items through multiple thread, batched by the flat combiner
+TEST(PerformanceTest, InsertTest3) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  skiplist.SetFlatCombining(true);
+
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  auto start_time = std::chrono::high_resolution_clock::now();
+  int thread_num = 4;
+  LuanchParallelTest(thread_num, InsertSplitHelper, &skiplist, keys, thread_num);
+  auto end_time = std::chrono::high_resolution_clock::now();
+
+  EXPECT_EQ(skiplist.Size(), keys.size());
+  auto span = end_time - start_time;
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+  std::cout << "\n--------------- Insert Performance (Four Threads, Flat Combining)--------------------" << std::endl;
+  std::cout << "Insert " << scale_keys << " items\n"
+            << "\t Time Duration: " << duration << std::endl
+            << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl;
+}
+
 // Lookup 100w items through single thread
 TEST(PerformanceTest, LookupTest1) {
   GenericComparator<8> comparator;
@@ -173,4 +289,700 @@ TEST(PerformanceTest, LookupTest2) {
             << "\t Time Duration: " << duration << std::endl
             << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl;
 }
-}  // namespace skiplist
\ No newline at end of file
+
+// Tear down 100w items, inline and on the background reclaimer
+TEST(PerformanceTest, ClearTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  std::cout << "\n--------------- Clear Performance (Single Thread)--------------------" << std::endl;
+  for (bool background : {false, true}) {
+    InsertHelper(&skiplist, keys);
+    EXPECT_EQ(skiplist.Size(), keys.size());
+    auto start_time = std::chrono::high_resolution_clock::now();
+    skiplist.Clear(background);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    EXPECT_EQ(skiplist.Size(), 0);
+
+    auto span = end_time - start_time;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+    std::cout << "Clear " << scale_keys << " items" << (background ? " in background" : "") << "\n"
+              << "\t Time Duration: " << duration << std::endl;
+  }
+}
+
+// Drop the middle 80% of 100w items, key by key and as one range
+TEST(PerformanceTest, RemoveRangeTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  int64_t first = scale_keys / 10;
+  int64_t last = scale_keys - scale_keys / 10;
+  GenericKey<8> index_key;
+  GenericKey<8> end_key;
+  std::cout << "\n--------------- RemoveRange Performance (Single Thread)--------------------" << std::endl;
+  for (bool range : {false, true}) {
+    InsertHelper(&skiplist, keys);
+    auto start_time = std::chrono::high_resolution_clock::now();
+    if (range) {
+      index_key.SetFromInteger(first);
+      end_key.SetFromInteger(last);
+      skiplist.RemoveRange(index_key, end_key);
+    } else {
+      for (int64_t key = first; key < last; key++) {
+        index_key.SetFromInteger(key);
+        skiplist.Remove(index_key);
+      }
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    EXPECT_EQ(skiplist.Size(), keys.size() - (last - first));
+
+    auto span = end_time - start_time;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+    std::cout << "Remove " << last - first << " items" << (range ? " as one range" : " one by one") << "\n"
+              << "\t Time Duration: " << duration << std::endl;
+    skiplist.Clear();
+  }
+}
+
+// Load 100w random pairs from a text and a binary file, against a line-by-line ifstream loop
+TEST(PerformanceTest, LoadFromFileTest) {
+  using TestList = SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  int scale_keys = 1000000;
+  std::mt19937_64 rnd(0xdeadbeef);
+  std::string text_name = "load_performance.txt";
+  std::string binary_name = "load_performance.bin";
+  {
+    std::ofstream text(text_name);
+    std::ofstream binary(binary_name, std::ios::binary);
+    for (int i = 0; i < scale_keys; i++) {
+      int64_t record[2] = {static_cast<int64_t>(rnd() >> 2), i};
+      text << record[0] << " " << record[1] << "\n";
+      binary.write(reinterpret_cast<const char *>(record), sizeof(record));
+    }
+  }
+
+  std::cout << "\n--------------- Load Performance --------------------" << std::endl;
+  {
+    TestList skiplist(comparator, max_height);
+    auto bytes = std::ifstream(text_name, std::ios::ate).tellg();
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::ifstream input(text_name);
+    int64_t key;
+    int64_t value;
+    GenericKey<8> index_key;
+    GenericValue<8> index_value;
+    while (input >> key >> value) {
+      index_key.SetFromInteger(key);
+      index_value.SetFromInteger(value);
+      skiplist.Insert(index_key, index_value);
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(end_time - start_time).count();
+    EXPECT_EQ(skiplist.Size(), scale_keys);
+    std::cout << "ifstream and Insert, text\n"
+              << "\t Time Duration: " << static_cast<int64_t>(seconds * 1000000) << "\n"
+              << "\t Throughout: " << bytes / seconds / (1 << 20) << " MB/s" << std::endl;
+  }
+  for (auto format : {FileFormat::TEXT, FileFormat::BINARY}) {
+    TestList skiplist(comparator, max_height);
+    LoadStats stats;
+    EXPECT_EQ(true, skiplist.LoadFromFile(format == FileFormat::TEXT ? text_name : binary_name, format, 0, &stats));
+    EXPECT_EQ(skiplist.Size(), scale_keys);
+    std::cout << "LoadFromFile, " << (format == FileFormat::TEXT ? "text" : "binary") << "\n"
+              << "\t Time Duration: " << static_cast<int64_t>(stats.seconds_ * 1000000) << " (parse and sort "
+              << static_cast<int64_t>(stats.parse_seconds_ * 1000000) << ")\n"
+              << "\t Throughout: " << stats.MBPerSecond() << " MB/s" << std::endl;
+  }
+  std::remove(text_name.c_str());
+  std::remove(binary_name.c_str());
+}
+
+// Lookup 100w items through single thread on the frozen copy
+TEST(PerformanceTest, FrozenLookupTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  InsertHelper(&skiplist, keys);
+  auto frozen = skiplist.Freeze();
+  skiplist.Clear();
+  EXPECT_EQ(frozen->Size(), keys.size());
+
+  GenericKey<8> index_key;
+  std::vector<GenericValue<8>> result;
+  auto start_time = std::chrono::high_resolution_clock::now();
+  for (const auto &key : keys) {
+    index_key.SetFromInteger(key);
+    result.clear();
+    frozen->Lookup(index_key, &result);
+    EXPECT_EQ(result[0].ToInteger(), key);
+  }
+  auto end_time = std::chrono::high_resolution_clock::now();
+
+  auto span = end_time - start_time;
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+  std::cout << "\n--------------- Frozen Lookup Performance (Single Thread)--------------------" << std::endl;
+  std::cout << "Lookup " << scale_keys << " items\n"
+            << "\t Time Duration: " << duration << std::endl
+            << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl
+            << "\t Memory: " << frozen->MemoryUsage() << " bytes" << std::endl;
+}
+
+// Lookup 100w items through single thread on the unrolled (16 keys per node) variant
+TEST(PerformanceTest, UnrolledLookupTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  UnrolledSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  for (const auto &key : keys) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key);
+    skiplist.Insert(index_key, index_value);
+  }
+  EXPECT_EQ(skiplist.Size(), keys.size());
+
+  std::vector<GenericValue<8>> result;
+  auto start_time = std::chrono::high_resolution_clock::now();
+  for (const auto &key : keys) {
+    index_key.SetFromInteger(key);
+    result.clear();
+    skiplist.Lookup(index_key, &result);
+    EXPECT_EQ(result[0].ToInteger(), key);
+  }
+  auto end_time = std::chrono::high_resolution_clock::now();
+
+  auto span = end_time - start_time;
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+  std::cout << "\n--------------- Unrolled Lookup Performance (Single Thread)--------------------" << std::endl;
+  std::cout << "Lookup " << scale_keys << " items in " << skiplist.NodeCount() << " nodes\n"
+            << "\t Time Duration: " << duration << std::endl
+            << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl;
+}
+
+// Lookup 100w absent keys through single thread, with and without the Bloom filter in front
+TEST(PerformanceTest, MissLookupTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(2 * i);
+  }
+
+  std::cout << "\n--------------- Miss Lookup Performance (Single Thread)--------------------" << std::endl;
+  for (bool filter : {false, true}) {
+    SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+    if (filter) {
+      skiplist.EnableFilter(scale_keys);
+    }
+    InsertHelper(&skiplist, keys);
+
+    GenericKey<8> index_key;
+    std::vector<GenericValue<8>> result;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (const auto &key : keys) {
+      index_key.SetFromInteger(key + 1);
+      EXPECT_EQ(skiplist.Lookup(index_key, &result), false);
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+
+    auto span = end_time - start_time;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+    std::cout << "Lookup " << scale_keys << " absent items" << (filter ? " with filter" : "") << "\n"
+              << "\t Time Duration: " << duration << std::endl
+              << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl;
+    if (filter) {
+      std::cout << "\t False Positive Rate: " << skiplist.FilterFalsePositiveRate() << std::endl
+                << "\t Bits Per Key: " << skiplist.FilterBitsPerKey() << std::endl;
+    }
+  }
+}
+
+// Fill a 4MB memtable with and without writer throttling past half of the budget
+TEST(PerformanceTest, MemoryLimitTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  size_t limit = 4 << 20;
+  std::cout << "\n--------------- Memory Limit (Single Thread)--------------------" << std::endl;
+  for (bool throttle : {false, true}) {
+    SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+    bool full = false;
+    skiplist.SetMemoryLimit(limit, [&full]() { full = true; }, throttle ? 0.5 : 1.0,
+                            std::chrono::microseconds(throttle ? 20 : 0));
+    GenericKey<8> index_key;
+    GenericValue<8> index_value;
+    int64_t inserted = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (int64_t key = 0;; key++) {
+      index_key.SetFromInteger(key);
+      index_value.SetFromInteger(key);
+      if (!skiplist.Insert(index_key, index_value)) {
+        break;
+      }
+      inserted++;
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    EXPECT_EQ(full, true);
+    EXPECT_GE(skiplist.ApproximateMemoryUsage(), limit);
+
+    auto span = end_time - start_time;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+    std::cout << "Insert " << inserted << " items until " << skiplist.ApproximateMemoryUsage() << " bytes"
+              << (throttle ? " with throttling" : "") << "\n"
+              << "\t Time Duration: " << duration << std::endl
+              << "\t Bytes Per Key: " << (float)skiplist.ApproximateMemoryUsage() / inserted << std::endl;
+  }
+}
+
+// Lookup 100w items in random order through single thread, nodes on 4K pages vs 2MB pages
+TEST(PerformanceTest, HugePageLookupTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xdeadbeef));
+
+  std::cout << "\n--------------- Huge Page Lookup Performance (Single Thread)--------------------" << std::endl;
+  for (bool huge_pages : {false, true}) {
+    SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+    if (huge_pages) {
+      skiplist.UseHugePages();
+    }
+    InsertHelper(&skiplist, keys);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(0xbeefdead));
+
+    DTLBMissCounter counter;
+    if (counter.Valid()) {
+      counter.Start();
+    }
+    auto start_time = std::chrono::high_resolution_clock::now();
+    LookupHelper(&skiplist, keys);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    uint64_t misses = counter.Valid() ? counter.Stop() : 0;
+
+    auto span = end_time - start_time;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+    std::cout << "Lookup " << scale_keys << " items on " << (huge_pages ? "2MB" : "4K") << " pages\n"
+              << "\t Time Duration: " << duration << std::endl
+              << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl;
+    if (counter.Valid()) {
+      std::cout << "\t dTLB Misses Per Lookup: " << (float)misses / scale_keys << std::endl;
+    } else {
+      std::cout << "\t dTLB Misses Per Lookup: n/a (no hardware counter)" << std::endl;
+    }
+  }
+}
+
+// Insert and look up 100w KeySize-byte keys in a PrefixSkipList, reporting memory per key
+template <size_t KeySize>
+void PrefixLookupHelper(const std::vector<int64_t> &keys) {
+  GenericComparator<KeySize> comparator;
+  PrefixSkipList<GenericKey<KeySize>, GenericValue<8>, GenericComparator<KeySize>> skiplist(comparator, 12);
+  GenericKey<KeySize> index_key;
+  GenericValue<8> index_value;
+  for (auto key : keys) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key);
+    skiplist.Insert(index_key, index_value);
+  }
+  std::vector<GenericValue<8>> result;
+  auto start_time = std::chrono::high_resolution_clock::now();
+  for (auto key : keys) {
+    index_key.SetFromInteger(key);
+    result.clear();
+    skiplist.Lookup(index_key, &result);
+    EXPECT_EQ(result.size(), 1);
+  }
+  auto end_time = std::chrono::high_resolution_clock::now();
+
+  auto span = end_time - start_time;
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+  std::cout << "Lookup " << keys.size() << " items of " << KeySize << " bytes\n"
+            << "\t Time Duration: " << duration << std::endl
+            << "\t Throughout: " << (float)(keys.size()) * 1e6 / duration << std::endl
+            << "\t Key Bytes Per Key: " << (float)skiplist.KeyBytes() / skiplist.Size() << std::endl
+            << "\t Bytes Per Key: " << (float)skiplist.ApproximateMemoryUsage() / skiplist.Size() << std::endl;
+}
+
+// Prefix/suffix compressed keys against the plain SkipList
+TEST(PerformanceTest, PrefixLookupTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xdeadbeef));
+  InsertHelper(&skiplist, keys);
+
+  std::cout << "\n--------------- Prefix Compressed Lookup Performance (Single Thread)--------------------" << std::endl;
+  auto start_time = std::chrono::high_resolution_clock::now();
+  LookupHelper(&skiplist, keys);
+  auto end_time = std::chrono::high_resolution_clock::now();
+  auto span = end_time - start_time;
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+  std::cout << "Lookup " << scale_keys << " items of 8 bytes in SkipList\n"
+            << "\t Time Duration: " << duration << std::endl
+            << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl
+            << "\t Bytes Per Key: " << (float)skiplist.ApproximateMemoryUsage() / skiplist.Size() << std::endl;
+  skiplist.Clear();
+
+  PrefixLookupHelper<8>(keys);
+  PrefixLookupHelper<32>(keys);
+  PrefixLookupHelper<64>(keys);
+}
+
+// Memory per key of SkipList and CompactSkipList, at 100w keys and, with SKIPLIST_LARGE_SCALE set, at 1000w and
+// 10000w. SkipList stops at 1000w, beyond which it needs more memory than most test hosts have.
+TEST(PerformanceTest, CompactMemoryTest) {
+  std::vector<int> scales{1000000};
+  if (std::getenv("SKIPLIST_LARGE_SCALE") != nullptr) {
+    scales.push_back(10000000);
+    scales.push_back(100000000);
+  }
+  std::cout << "\n--------------- Bytes Per Key (8-byte keys and values)--------------------" << std::endl;
+  for (int scale_keys : scales) {
+    // random lookups over the whole range
+    std::vector<int64_t> probes;
+    std::mt19937_64 rng(0xdeadbeef);
+    for (int i = 0; i < 1000000; i++) {
+      probes.push_back(rng() % scale_keys + 1);
+    }
+    GenericComparator<8> comparator;
+    GenericKey<8> index_key;
+    GenericValue<8> index_value;
+    if (scale_keys <= 10000000) {
+      SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, 27);
+      for (int i = 1; i <= scale_keys; i++) {
+        index_key.SetFromInteger(i);
+        index_value.SetFromInteger(i);
+        skiplist.Insert(index_key, index_value);
+      }
+      auto start_time = std::chrono::high_resolution_clock::now();
+      LookupHelper(&skiplist, probes);
+      auto end_time = std::chrono::high_resolution_clock::now();
+      auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+      std::cout << "SkipList with " << scale_keys << " items\n"
+                << "\t Bytes Per Key: " << (float)skiplist.ApproximateMemoryUsage() / scale_keys << std::endl
+                << "\t Lookup Throughout: " << (float)(probes.size()) * 1e6 / duration << std::endl;
+    }
+    CompactSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> compact(comparator, 27);
+    for (int i = 1; i <= scale_keys; i++) {
+      index_key.SetFromInteger(i);
+      index_value.SetFromInteger(i);
+      compact.Insert(index_key, index_value);
+    }
+    EXPECT_EQ(compact.Size(), scale_keys);
+    std::vector<GenericValue<8>> result;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (auto key : probes) {
+      index_key.SetFromInteger(key);
+      result.clear();
+      compact.Lookup(index_key, &result);
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+    std::cout << "CompactSkipList with " << scale_keys << " items\n"
+              << "\t Bytes Per Key: " << (float)compact.ApproximateMemoryUsage() / scale_keys << std::endl
+              << "\t Lookup Throughout: " << (float)(probes.size()) * 1e6 / duration << std::endl;
+  }
+}
+
+// Lookup 100w items drawn from Zipf 0.99, before and after hot keys are promoted
+TEST(PerformanceTest, ZipfLookupTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xdeadbeef));
+  InsertHelper(&skiplist, keys);
+  // the popularity rank is unrelated to the key order
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xbeefdead));
+  ZipfGenerator zipf(scale_keys, 0.99, 0xdeadbeef);
+  std::vector<int64_t> traffic;
+  for (int i = 0; i < scale_keys; i++) {
+    traffic.push_back(keys[zipf.Next()]);
+  }
+
+  std::cout << "\n--------------- Zipf 0.99 Lookup Performance (Single Thread)--------------------" << std::endl;
+  for (bool biased : {false, true}) {
+    if (biased) {
+      // one round of sampled traffic, then promote
+      skiplist.SetAccessBias(true);
+      LookupHelper(&skiplist, traffic);
+      skiplist.Rebalance();
+    }
+    auto start_time = std::chrono::high_resolution_clock::now();
+    LookupHelper(&skiplist, traffic);
+    auto end_time = std::chrono::high_resolution_clock::now();
+
+    auto span = end_time - start_time;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+    std::cout << "Lookup " << scale_keys << " items " << (biased ? "with hot keys promoted" : "at random heights")
+              << "\n"
+              << "\t Time Duration: " << duration << std::endl
+              << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl;
+  }
+}
+
+// Lookup 100w items by plain descent and through the learned index, on lognormal and on sequential keys
+TEST(PerformanceTest, LearnedLookupTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  size_t scale_keys = 1000000;
+  std::mt19937 gen(0xdeadbeef);
+  std::lognormal_distribution<double> lognormal(0, 2);
+  std::vector<int64_t> lognormal_keys;
+  for (size_t i = 0; i < scale_keys * 11 / 10; i++) {
+    lognormal_keys.push_back(static_cast<int64_t>(lognormal(gen) * 1e9));
+  }
+  std::sort(lognormal_keys.begin(), lognormal_keys.end());
+  lognormal_keys.erase(std::unique(lognormal_keys.begin(), lognormal_keys.end()), lognormal_keys.end());
+  lognormal_keys.resize(std::min(lognormal_keys.size(), scale_keys));
+  std::vector<int64_t> sequential_keys;
+  for (size_t i = 1; i <= scale_keys; i++) {
+    sequential_keys.push_back(i);
+  }
+
+  std::cout << "\n--------------- Learned Index Lookup Performance (Single Thread)--------------------" << std::endl;
+  for (auto keys : {lognormal_keys, sequential_keys}) {
+    const char *name = keys == lognormal_keys ? "lognormal" : "sequential";
+    SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+    std::shuffle(keys.begin(), keys.end(), gen);
+    InsertHelper(&skiplist, keys);
+    std::shuffle(keys.begin(), keys.end(), gen);
+    for (bool learned : {false, true}) {
+      skiplist.EnableLearnedIndex(learned);
+      auto start_time = std::chrono::high_resolution_clock::now();
+      LookupHelper(&skiplist, keys);
+      auto end_time = std::chrono::high_resolution_clock::now();
+
+      auto span = end_time - start_time;
+      auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+      std::cout << "Lookup " << keys.size() << " " << name << " items "
+                << (learned ? "through the learned index" : "by plain descent") << "\n"
+                << "\t Time Duration: " << duration << std::endl
+                << "\t Throughout: " << (float)(keys.size()) * 1e6 / duration << std::endl;
+      if (learned) {
+        std::cout << "\t Segments: " << skiplist.LearnedSegments() << std::endl;
+      }
+    }
+  }
+}
+
+// Intersect 100w items with 1k to 100w items: Lookup per key against the galloping walk
+TEST(PerformanceTest, IntersectTest) {
+  using List = SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  int scale_keys = 1000000;
+  std::mt19937 gen(0xdeadbeef);
+  std::vector<int64_t> keys;
+  for (int i = 0; i < scale_keys; i++) {
+    keys.push_back(2 * i);
+  }
+  std::shuffle(keys.begin(), keys.end(), gen);
+  List large(comparator, max_height);
+  InsertHelper(&large, keys);
+
+  std::cout << "\n--------------- Intersect Performance (Single Thread)--------------------" << std::endl;
+  for (int small_keys : {1000, 100000, 1000000}) {
+    // half of them hit
+    std::vector<int64_t> probes;
+    for (int i = 0; i < small_keys; i++) {
+      probes.push_back(gen() % (2 * scale_keys));
+    }
+    List small(comparator, max_height);
+    InsertHelper(&small, probes);
+    for (bool gallop : {false, true}) {
+      size_t count = 0;
+      auto start_time = std::chrono::high_resolution_clock::now();
+      if (gallop) {
+        count = small.CountIntersection(&large);
+      } else {
+        std::vector<GenericValue<8>> result;
+        for (auto kv : small) {
+          count += large.Lookup(kv.first, &result) ? 1 : 0;
+        }
+      }
+      auto end_time = std::chrono::high_resolution_clock::now();
+
+      auto span = end_time - start_time;
+      auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+      std::cout << "Intersect " << small.Size() << " with " << scale_keys << " items "
+                << (gallop ? "by galloping" : "by Lookup") << ": " << count << " common\n"
+                << "\t Time Duration: " << duration << std::endl;
+    }
+  }
+}
+
+// Insert 100w items without and with the change feed, the subscriber draining it after every 64k inserts
+TEST(PerformanceTest, ChangeFeedTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xdeadbeef));
+
+  std::cout << "\n--------------- Change Feed Insert Performance (Single Thread)--------------------" << std::endl;
+  for (bool feed : {false, true}) {
+    SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+    std::unique_ptr<ChangeFeed<GenericKey<8>, GenericValue<8>>::Subscriber> subscriber;
+    if (feed) {
+      skiplist.EnableChangeFeed(1 << 17);
+      subscriber = skiplist.Subscribe();
+    }
+    std::vector<ChangeRecord<GenericKey<8>, GenericValue<8>>> records;
+    GenericKey<8> index_key;
+    GenericValue<8> index_value;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < scale_keys; i++) {
+      index_key.SetFromInteger(keys[i]);
+      index_value.SetFromInteger(keys[i]);
+      skiplist.Insert(index_key, index_value);
+      if (feed && (i & 0xffff) == 0xffff) {
+        records.clear();
+        subscriber->Poll(&records, 1 << 17);
+      }
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    if (feed) {
+      EXPECT_EQ(0, subscriber->Dropped());
+    }
+
+    auto span = end_time - start_time;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+    std::cout << "Insert " << scale_keys << " items " << (feed ? "with the change feed" : "without a change feed")
+              << "\n"
+              << "\t Time Duration: " << duration << std::endl
+              << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl;
+  }
+}
+
+// Scan 100w items, split over 1 to 8 threads
+TEST(PerformanceTest, ParallelScanTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xdeadbeef));
+  InsertHelper(&skiplist, keys);
+
+  std::cout << "\n--------------- Parallel Scan Performance (" << std::thread::hardware_concurrency()
+            << " Cores)--------------------" << std::endl;
+  for (size_t threads : {1, 2, 4, 8}) {
+    std::atomic<int64_t> total{0};
+    auto start_time = std::chrono::high_resolution_clock::now();
+    skiplist.ParallelForEach(
+        [&total](const GenericKey<8> &key, const GenericValue<8> &value) {
+          total.fetch_add(value.ToInteger(), std::memory_order_relaxed);
+        },
+        threads);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    EXPECT_EQ(total.load(), (int64_t)scale_keys * (scale_keys + 1) / 2);
+
+    auto span = end_time - start_time;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+    std::cout << "Scan " << scale_keys << " items with " << threads << " threads\n"
+              << "\t Time Duration: " << duration << std::endl
+              << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl;
+  }
+}
+
+#ifdef __cpp_impl_coroutine
+Task<void> AsyncLookupHelper(SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> *skiplist,
+                             const std::vector<int64_t> &keys, int thread_num, int thread_iter) {
+  GenericKey<8> index_key;
+  std::vector<GenericValue<8>> result;
+  for (size_t i = thread_iter; i < keys.size(); i += thread_num) {
+    index_key.SetFromInteger(keys[i]);
+    result.clear();
+    co_await skiplist->LookupAsync(index_key, &result);
+    EXPECT_EQ(result.size(), 1);
+  }
+}
+
+// Lookup 100w items in random order on one thread, synchronously vs interleaved coroutines with many keys in flight
+TEST(PerformanceTest, AsyncLookupTest) {
+  GenericComparator<8> comparator;
+  int max_height = 18;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  int scale_keys = 1000000;
+  std::vector<int64_t> keys;
+  for (int i = 1; i <= scale_keys; i++) {
+    keys.push_back(i);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xdeadbeef));
+  InsertHelper(&skiplist, keys);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xbeefdead));
+
+  std::cout << "\n--------------- Async Lookup Performance (Single Thread)--------------------" << std::endl;
+  for (int in_flight : {0, 1, 8, 32}) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    if (in_flight == 0) {
+      LookupHelper(&skiplist, keys);
+    } else {
+      InterleavedExecutor executor;
+      for (int t = 0; t < in_flight; t++) {
+        executor.Spawn(AsyncLookupHelper(&skiplist, keys, in_flight, t));
+      }
+      executor.Run();
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+
+    auto span = end_time - start_time;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(span).count();
+    if (in_flight == 0) {
+      std::cout << "Lookup " << scale_keys << " items synchronously\n";
+    } else {
+      std::cout << "Lookup " << scale_keys << " items with " << in_flight << " in flight\n";
+    }
+    std::cout << "\t Time Duration: " << duration << std::endl
+              << "\t Throughout: " << (float)(scale_keys)*1e6 / duration << std::endl;
+  }
+}
+#endif
+}  // namespace skiplist
@@ -1,3 +1,10 @@
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <set>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "generic_key.h"
@@ -192,4 +199,1076 @@ TEST(SkipListTest, MixTest1) {
     i++;
   }
 }
-}  // namespace skiplist
\ No newline at end of file
+
+TEST(SkipListTest, RankSelectTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  // keys 2, 4, ..., 2000
+  int scale_keys = 1000;
+  for (int i = 1; i <= scale_keys; i++) {
+    index_key.SetFromInteger(2 * i);
+    index_value.SetFromInteger(2 * i);
+    skiplist.Insert(index_key, index_value);
+  }
+
+  for (int i = 1; i <= scale_keys; i++) {
+    index_key.SetFromInteger(2 * i);
+    EXPECT_EQ(skiplist.Rank(index_key), i - 1);
+    index_key.SetFromInteger(2 * i + 1);
+    EXPECT_EQ(skiplist.Rank(index_key), i);
+  }
+
+  GenericKey<8> result_key;
+  GenericValue<8> result_value;
+  for (int i = 0; i < scale_keys; i++) {
+    EXPECT_EQ(true, skiplist.Select(i, &result_key, &result_value));
+    EXPECT_EQ(result_key.ToInteger(), 2 * (i + 1));
+    EXPECT_EQ(result_value.ToInteger(), 2 * (i + 1));
+  }
+  EXPECT_EQ(false, skiplist.Select(scale_keys, &result_key, &result_value));
+
+  GenericKey<8> end_key;
+  index_key.SetFromInteger(100);
+  end_key.SetFromInteger(201);
+  EXPECT_EQ(skiplist.CountRange(index_key, end_key), 51);
+  EXPECT_EQ(skiplist.CountRange(end_key, index_key), 0);
+
+  // remove every multiple of 4, the spans have to follow
+  for (int i = 2; i <= scale_keys; i += 2) {
+    index_key.SetFromInteger(2 * i);
+    EXPECT_EQ(true, skiplist.Remove(index_key));
+  }
+  for (int i = 0; i < scale_keys / 2; i++) {
+    EXPECT_EQ(true, skiplist.Select(i, &result_key, &result_value));
+    EXPECT_EQ(result_key.ToInteger(), 4 * i + 2);
+  }
+
+  int i = 250;
+  for (auto iter = skiplist.Seek(250); iter != skiplist.end(); ++iter) {
+    EXPECT_EQ((*iter).first.ToInteger(), 4 * i + 2);
+    i++;
+  }
+  EXPECT_EQ(i, scale_keys / 2);
+  EXPECT_EQ(skiplist.Seek(scale_keys / 2), skiplist.end());
+}
+
+TEST(SkipListTest, RemoveRangeTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericKey<8> end_key;
+  GenericValue<8> index_value;
+  std::vector<GenericValue<8>> result;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  skiplist.EnableFilter(10000);
+
+  // keys 0, 2, ..., 19998
+  int scale_keys = 10000;
+  std::set<int64_t> alive;
+  for (int i = 0; i < scale_keys; i++) {
+    index_key.SetFromInteger(2 * i);
+    index_value.SetFromInteger(2 * i);
+    skiplist.Insert(index_key, index_value);
+    alive.insert(2 * i);
+  }
+  // empty and reversed ranges, a middle range with odd bounds, the head and the tail
+  std::vector<std::pair<int64_t, int64_t>> ranges{{501, 501}, {900, 100}, {1001, 1003}, {3001, 8999},
+                                                  {-5, 1},    {19000, 30000}};
+  std::vector<size_t> removed{0, 0, 1, 2999, 1, 500};
+  for (size_t r = 0; r < ranges.size(); r++) {
+    index_key.SetFromInteger(ranges[r].first);
+    end_key.SetFromInteger(ranges[r].second);
+    EXPECT_EQ(skiplist.RemoveRange(index_key, end_key), removed[r]);
+    alive.erase(alive.lower_bound(ranges[r].first), alive.lower_bound(std::max(ranges[r].first, ranges[r].second)));
+  }
+  EXPECT_EQ(skiplist.Size(), alive.size());
+
+  // lookups, spans and back links all follow the splices
+  for (int64_t key = -1; key <= 2 * scale_keys; key++) {
+    result.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_EQ(alive.count(key) != 0, skiplist.Lookup(index_key, &result));
+  }
+  std::vector<int64_t> expected(alive.begin(), alive.end());
+  GenericKey<8> result_key;
+  GenericValue<8> result_value;
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(true, skiplist.Select(i, &result_key, &result_value));
+    EXPECT_EQ(result_key.ToInteger(), expected[i]);
+  }
+  std::vector<int64_t> backward;
+  for (auto iter = skiplist.rbegin(); iter != skiplist.rend(); ++iter) {
+    backward.push_back((*iter).first.ToInteger());
+  }
+  std::reverse(backward.begin(), backward.end());
+  EXPECT_EQ(backward, expected);
+
+  // inserts take their nodes from the detached ranges before the arena grows
+  size_t memory = skiplist.ApproximateMemoryUsage();
+  for (int64_t key = 3001; key < 8999; key += 2) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key);
+    EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+  }
+  EXPECT_LT(skiplist.ApproximateMemoryUsage(), memory * 11 / 10);
+
+  size_t size = skiplist.Size();
+  index_key.SetFromInteger(0);
+  end_key.SetFromInteger(2 * scale_keys);
+  EXPECT_EQ(skiplist.RemoveRange(index_key, end_key), size);
+  EXPECT_EQ(skiplist.RemoveRange(index_key, end_key), 0);
+  EXPECT_EQ(skiplist.Size(), 0);
+  EXPECT_EQ(skiplist.begin(), skiplist.end());
+  EXPECT_EQ(skiplist.rbegin(), skiplist.rend());
+}
+
+TEST(SkipListTest, SplitJoinTest) {
+  using TestList = SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+  GenericComparator<8> comparator;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  auto fill = [&](TestList *skiplist, int64_t begin, int64_t end) {
+    for (int64_t key = begin; key < end; key++) {
+      index_key.SetFromInteger(key);
+      index_value.SetFromInteger(key);
+      EXPECT_EQ(true, skiplist->Insert(index_key, index_value));
+    }
+  };
+  // keys, values, spans and back links all have to agree with [begin, end)
+  auto check = [&](TestList *skiplist, int64_t begin, int64_t end) {
+    EXPECT_EQ(skiplist->Size(), end - begin);
+    std::vector<GenericValue<8>> result;
+    for (int64_t key = begin - 1; key <= end; key++) {
+      result.clear();
+      index_key.SetFromInteger(key);
+      EXPECT_EQ(key >= begin && key < end, skiplist->Lookup(index_key, &result));
+    }
+    GenericKey<8> result_key;
+    for (int64_t key = begin; key < end; key++) {
+      EXPECT_EQ(true, skiplist->Select(key - begin, &result_key, &index_value));
+      EXPECT_EQ(result_key.ToInteger(), key);
+      EXPECT_EQ(index_value.ToInteger(), key);
+    }
+    int64_t key = end;
+    for (auto iter = skiplist->rbegin(); iter != skiplist->rend(); ++iter) {
+      EXPECT_EQ((*iter).first.ToInteger(), --key);
+    }
+    EXPECT_EQ(key, begin);
+  };
+
+  std::unique_ptr<TestList> right;
+  TestList skiplist(comparator, 12);
+  {
+    // the split-off list outlives the list whose arena holds its nodes
+    TestList source(comparator, 12);
+    fill(&source, 0, 10000);
+    index_key.SetFromInteger(6000);
+    right = source.Split(index_key);
+    check(&source, 0, 6000);
+    index_key.SetFromInteger(0);
+    auto all = source.Split(index_key);
+    check(all.get(), 0, 6000);
+    check(&source, 0, 0);
+  }
+  check(right.get(), 6000, 10000);
+  index_key.SetFromInteger(20000);
+  EXPECT_EQ(right->Split(index_key)->Size(), 0);
+  fill(right.get(), 10000, 12000);
+  check(right.get(), 6000, 12000);
+
+  // behind, in front of, and overlapping the existing keys
+  fill(&skiplist, 0, 6000);
+  EXPECT_EQ(true, skiplist.Join(right.get()));
+  check(&skiplist, 0, 12000);
+  check(right.get(), 0, 0);
+  fill(right.get(), 0, 10);
+  EXPECT_EQ(false, skiplist.Join(right.get()));
+  EXPECT_EQ(false, skiplist.Join(&skiplist));
+  check(&skiplist, 0, 12000);
+  check(right.get(), 0, 10);
+
+  // lists of other heights: a shorter one goes in front, a taller one grows the head
+  TestList shorter(comparator, 3);
+  fill(&shorter, -3000, 0);
+  EXPECT_EQ(true, skiplist.Join(&shorter));
+  check(&skiplist, -3000, 12000);
+  TestList taller(comparator, 16);
+  fill(&taller, 12000, 15000);
+  skiplist.EnableFilter(20000);
+  EXPECT_EQ(true, skiplist.Join(&taller));
+  check(&skiplist, -3000, 15000);
+  fill(&taller, 0, 100);
+  check(&taller, 0, 100);
+
+  // split again at every tenth of the joined list and glue the pieces back in reverse order
+  std::vector<std::unique_ptr<TestList>> pieces;
+  for (int64_t cut = 13200; cut > -3000; cut -= 1800) {
+    index_key.SetFromInteger(cut);
+    pieces.push_back(skiplist.Split(index_key));
+  }
+  check(&skiplist, -3000, -1200);
+  for (auto iter = pieces.rbegin(); iter != pieces.rend(); ++iter) {
+    EXPECT_EQ(true, (*iter)->Join(&skiplist));
+    skiplist.Join(iter->get());
+  }
+  check(&skiplist, -3000, 15000);
+  index_key.SetFromInteger(7);
+  EXPECT_EQ(true, skiplist.Remove(index_key));
+  index_value.SetFromInteger(7);
+  EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+  check(&skiplist, -3000, 15000);
+
+  // rebalancing shards splits and joins the same lists over and over, which must not pile up arena references
+  TestList shard(comparator, 12);
+  fill(&shard, 0, 10);
+  for (int round = 0; round < 200; round++) {
+    index_key.SetFromInteger(5);
+    auto rest = shard.Split(index_key);
+    fill(rest.get(), 10 + round, 11 + round);
+    EXPECT_EQ(true, shard.Join(rest.get()));
+  }
+  check(&shard, 0, 210);
+}
+
+TEST(SkipListTest, SetAlgebraTest) {
+  using List = SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  List lhs(comparator, max_height);
+  List rhs(comparator, max_height);
+
+  // lhs is dense, rhs sparse with runs that lhs lacks; values tell the two apart
+  std::mt19937 gen(0xdeadbeef);
+  std::set<int64_t> lhs_keys;
+  std::set<int64_t> rhs_keys;
+  for (int i = 0; i < 20000; i++) {
+    lhs_keys.insert(gen() % 40000);
+  }
+  for (int i = 0; i < 500; i++) {
+    rhs_keys.insert(gen() % 60000 - 10000);
+  }
+  for (auto key : lhs_keys) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key);
+    lhs.Insert(index_key, index_value);
+  }
+  for (auto key : rhs_keys) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(-key - 1);
+    rhs.Insert(index_key, index_value);
+  }
+  std::vector<int64_t> intersection;
+  std::vector<int64_t> union_keys;
+  std::vector<int64_t> difference;
+  std::set_intersection(lhs_keys.begin(), lhs_keys.end(), rhs_keys.begin(), rhs_keys.end(),
+                        std::back_inserter(intersection));
+  std::set_union(lhs_keys.begin(), lhs_keys.end(), rhs_keys.begin(), rhs_keys.end(), std::back_inserter(union_keys));
+  std::set_difference(lhs_keys.begin(), lhs_keys.end(), rhs_keys.begin(), rhs_keys.end(),
+                      std::back_inserter(difference));
+  auto check = [&](List *list, const std::vector<int64_t> &expected) {
+    EXPECT_EQ(expected.size(), list->Size());
+    size_t i = 0;
+    for (auto kv : *list) {
+      EXPECT_EQ(expected[i], kv.first.ToInteger());
+      // keys that lhs holds keep its value
+      int64_t value = lhs_keys.count(expected[i]) != 0 ? expected[i] : -expected[i] - 1;
+      EXPECT_EQ(value, kv.second.ToInteger());
+      i++;
+    }
+    // a built list is a list like any other
+    for (auto key : expected) {
+      std::vector<GenericValue<8>> result;
+      index_key.SetFromInteger(key);
+      EXPECT_EQ(true, list->Lookup(index_key, &result));
+    }
+  };
+  check(lhs.Intersect(&rhs).get(), intersection);
+  check(lhs.Union(&rhs).get(), union_keys);
+  check(lhs.Difference(&rhs).get(), difference);
+  EXPECT_EQ(intersection.size(), lhs.CountIntersection(&rhs));
+  EXPECT_EQ(intersection.size(), rhs.CountIntersection(&lhs));
+
+  // lazy, and the other way round
+  std::vector<int64_t> keys;
+  for (auto kv : rhs.View(List::SetOperation::DIFFERENCE, &lhs)) {
+    keys.push_back(kv.first.ToInteger());
+  }
+  std::vector<int64_t> expected;
+  std::set_difference(rhs_keys.begin(), rhs_keys.end(), lhs_keys.begin(), lhs_keys.end(), std::back_inserter(expected));
+  EXPECT_EQ(expected, keys);
+  keys.clear();
+  for (auto kv : lhs.View(List::SetOperation::INTERSECT, &rhs)) {
+    keys.push_back(kv.first.ToInteger());
+  }
+  EXPECT_EQ(intersection, keys);
+
+  // with itself, and with an empty list
+  List empty(comparator, max_height);
+  EXPECT_EQ(lhs_keys.size(), lhs.CountIntersection(&lhs));
+  EXPECT_EQ(0, lhs.Difference(&lhs)->Size());
+  EXPECT_EQ(0, lhs.CountIntersection(&empty));
+  EXPECT_EQ(lhs_keys.size(), lhs.Union(&empty)->Size());
+  EXPECT_EQ(lhs_keys.size(), empty.Union(&lhs)->Size());
+  EXPECT_EQ(0, empty.Difference(&lhs)->Size());
+
+  // expired entries are absent on either side: lhs holds 1 3 4 live and 2 6 expired, rhs 2 4 5 6 live and 3 expired
+  List lhs_ttl(comparator, max_height);
+  List rhs_ttl(comparator, max_height);
+  auto insert = [&](List *list, int64_t key, int64_t value, int ttl_ms) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(value);
+    if (ttl_ms == 0) {
+      list->Insert(index_key, index_value);
+    } else {
+      list->InsertWithTTL(index_key, index_value, std::chrono::milliseconds(ttl_ms));
+    }
+  };
+  for (auto key : {1, 3, 4}) {
+    insert(&lhs_ttl, key, key, 0);
+  }
+  for (auto key : {2, 6}) {
+    insert(&lhs_ttl, key, key, 1);
+  }
+  for (auto key : {2, 4, 5, 6}) {
+    insert(&rhs_ttl, key, -key, 0);
+  }
+  insert(&rhs_ttl, 3, -3, 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  auto pairs = [](List *list) {
+    std::vector<std::pair<int64_t, int64_t>> result;
+    for (auto kv : *list) {
+      result.emplace_back(kv.first.ToInteger(), kv.second.ToInteger());
+    }
+    return result;
+  };
+  using Pairs = std::vector<std::pair<int64_t, int64_t>>;
+  EXPECT_EQ((Pairs{{4, 4}}), pairs(lhs_ttl.Intersect(&rhs_ttl).get()));
+  EXPECT_EQ(1, lhs_ttl.CountIntersection(&rhs_ttl));
+  EXPECT_EQ(1, rhs_ttl.CountIntersection(&lhs_ttl));
+  EXPECT_EQ((Pairs{{1, 1}, {3, 3}}), pairs(lhs_ttl.Difference(&rhs_ttl).get()));
+  EXPECT_EQ((Pairs{{2, -2}, {5, -5}, {6, -6}}), pairs(rhs_ttl.Difference(&lhs_ttl).get()));
+  Pairs union_pairs{{1, 1}, {2, -2}, {3, 3}, {4, 4}, {5, -5}, {6, -6}};
+  EXPECT_EQ(union_pairs, pairs(lhs_ttl.Union(&rhs_ttl).get()));
+  Pairs viewed;
+  for (auto kv : lhs_ttl.View(List::SetOperation::UNION, &rhs_ttl)) {
+    viewed.emplace_back(kv.first.ToInteger(), kv.second.ToInteger());
+  }
+  EXPECT_EQ(union_pairs, viewed);
+}
+
+TEST(SkipListTest, LoadFromFileTest) {
+  using TestList = SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+  GenericComparator<8> comparator;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  std::vector<GenericValue<8>> result;
+
+  // big enough for several chunks; every tenth key shows up again later with another value, which must lose
+  int scale_keys = 300000;
+  std::vector<int64_t> keys;
+  for (int i = 0; i < scale_keys; i++) {
+    keys.push_back(i - scale_keys / 2);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0xdeadbeef));
+  std::vector<std::pair<int64_t, int64_t>> pairs;
+  for (auto key : keys) {
+    pairs.emplace_back(key, key * 2);
+  }
+  for (int i = 0; i < scale_keys; i += 10) {
+    pairs.emplace_back(keys[i], -1);
+  }
+  std::string text_name = "load_test.txt";
+  std::string binary_name = "load_test.bin";
+  {
+    std::ofstream text(text_name);
+    std::ofstream binary(binary_name, std::ios::binary);
+    for (size_t i = 0; i < pairs.size(); i++) {
+      text << pairs[i].first << (i % 7 == 0 ? "\t " : " ") << pairs[i].second << (i % 5 == 0 ? "\r\n\n" : "\n");
+      binary.write(reinterpret_cast<const char *>(&pairs[i]), sizeof(pairs[i]));
+    }
+  }
+
+  for (auto format : {FileFormat::TEXT, FileFormat::BINARY}) {
+    TestList skiplist(comparator, 16);
+    // a key already in the list keeps its value
+    index_key.SetFromInteger(keys[1]);
+    index_value.SetFromInteger(7);
+    skiplist.Insert(index_key, index_value);
+    LoadStats stats;
+    EXPECT_EQ(true, skiplist.LoadFromFile(format == FileFormat::TEXT ? text_name : binary_name, format, 4, &stats));
+    EXPECT_EQ(stats.records_, pairs.size());
+    EXPECT_EQ(stats.inserted_, scale_keys - 1);
+    EXPECT_GT(stats.MBPerSecond(), 0);
+    EXPECT_EQ(skiplist.Size(), scale_keys);
+    int64_t expected = -scale_keys / 2;
+    for (auto iter : skiplist) {
+      EXPECT_EQ(iter.first.ToInteger(), expected);
+      EXPECT_EQ(iter.second.ToInteger(), expected == keys[1] ? 7 : expected * 2);
+      expected++;
+    }
+    EXPECT_EQ(expected, scale_keys / 2);
+  }
+
+  // a broken file inserts nothing
+  {
+    std::ofstream text(text_name);
+    text << "1 2\n3 4\n5\n";
+    std::ofstream binary(binary_name, std::ios::binary);
+    binary << "not a whole record";
+  }
+  TestList skiplist(comparator, 16);
+  EXPECT_EQ(false, skiplist.LoadFromFile(text_name));
+  EXPECT_EQ(false, skiplist.LoadFromFile(binary_name, FileFormat::BINARY));
+  EXPECT_EQ(false, skiplist.LoadFromFile("no_such_file.txt"));
+  EXPECT_EQ(skiplist.Size(), 0);
+
+  // so does a number out of the int64_t range, while the range's own ends load
+  for (const char *value : {"9223372036854775808", "-9223372036854775809", "18446744073709551617"}) {
+    std::ofstream text(text_name);
+    text << "1 2\n3 " << value << "\n";
+    text.close();
+    EXPECT_EQ(false, skiplist.LoadFromFile(text_name));
+    EXPECT_EQ(skiplist.Size(), 0);
+  }
+  {
+    std::ofstream text(text_name);
+    text << "9223372036854775807 1\n-9223372036854775808 -9223372036854775808\n";
+  }
+  EXPECT_EQ(true, skiplist.LoadFromFile(text_name));
+  EXPECT_EQ(skiplist.Size(), 2);
+  index_key.SetFromInteger(INT64_MIN);
+  result.clear();
+  EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+  EXPECT_EQ(result[0].ToInteger(), INT64_MIN);
+  index_key.SetFromInteger(INT64_MAX);
+  EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+  std::remove(text_name.c_str());
+  std::remove(binary_name.c_str());
+}
+
+TEST(SkipListTest, ClearResetTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  std::vector<GenericValue<8>> result;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  int scale_keys = 1000;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 1; i <= scale_keys; i++) {
+      index_key.SetFromInteger(i + round);
+      index_value.SetFromInteger(i + round);
+      EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+    }
+    EXPECT_EQ(skiplist.Size(), scale_keys);
+    // freed nodes are handed out again
+    for (int i = 1; i <= scale_keys; i += 2) {
+      index_key.SetFromInteger(i + round);
+      EXPECT_EQ(true, skiplist.Remove(index_key));
+      index_value.SetFromInteger(-i);
+      EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+    }
+    int i = 1;
+    for (auto iter : skiplist) {
+      EXPECT_EQ(iter.first.ToInteger(), i + round);
+      EXPECT_EQ(iter.second.ToInteger(), i % 2 == 1 ? -i : i + round);
+      i++;
+    }
+
+    if (round == 0) {
+      skiplist.Reset();
+    } else {
+      skiplist.Clear(round == 2);
+    }
+    EXPECT_EQ(skiplist.Size(), 0);
+    EXPECT_EQ(skiplist.begin(), skiplist.end());
+    index_key.SetFromInteger(1 + round);
+    EXPECT_EQ(false, skiplist.Lookup(index_key, &result));
+  }
+}
+
+TEST(SkipListTest, EmplaceTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  int scale_keys = 1000;
+  for (int i = 1; i <= scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    if (i % 2 == 0) {
+      GenericKey<8> moved_key = index_key;
+      GenericValue<8> moved_value = index_value;
+      EXPECT_EQ(true, skiplist.Insert(std::move(moved_key), std::move(moved_value)));
+    } else {
+      EXPECT_EQ(true, skiplist.Emplace(index_key, index_value));
+    }
+    EXPECT_EQ(false, skiplist.Emplace(index_key, index_value));
+  }
+  EXPECT_EQ(skiplist.Size(), scale_keys);
+
+  // the iterator hands out references, so values can be updated in place
+  for (auto iter : skiplist) {
+    iter.second.SetFromInteger(-iter.first.ToInteger());
+  }
+
+  for (int i = 1; i <= scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    int64_t seen = 0;
+    EXPECT_EQ(true, skiplist.Lookup(index_key, [&](const GenericValue<8> &value) { seen = value.ToInteger(); }));
+    EXPECT_EQ(seen, -i);
+  }
+  index_key.SetFromInteger(scale_keys + 1);
+  EXPECT_EQ(false, skiplist.Lookup(index_key, [](const GenericValue<8> &value) { FAIL(); }));
+
+  // the combiner moves rvalues into the nodes it creates
+  skiplist.SetFlatCombining(true);
+  for (int i = scale_keys + 1; i <= 2 * scale_keys; i++) {
+    GenericKey<8> moved_key;
+    GenericValue<8> moved_value;
+    moved_key.SetFromInteger(i);
+    moved_value.SetFromInteger(i);
+    EXPECT_EQ(true, skiplist.Insert(std::move(moved_key), std::move(moved_value)));
+  }
+  EXPECT_EQ(skiplist.Size(), 2 * scale_keys);
+  for (int i = scale_keys + 1; i <= 2 * scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    int64_t seen = 0;
+    EXPECT_EQ(true, skiplist.Lookup(index_key, [&](const GenericValue<8> &value) { seen = value.ToInteger(); }));
+    EXPECT_EQ(seen, i);
+  }
+}
+
+TEST(SkipListTest, ReverseIteratorTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  EXPECT_EQ(skiplist.rbegin(), skiplist.rend());
+
+  // keys 10, 20, ..., 10000
+  int scale_keys = 1000;
+  for (int i = 1; i <= scale_keys; i++) {
+    index_key.SetFromInteger(10 * i);
+    index_value.SetFromInteger(10 * i);
+    skiplist.Insert(index_key, index_value);
+  }
+  // drop the head, the tail and every third key in between
+  for (int i = 1; i <= scale_keys; i++) {
+    if (i == 1 || i == scale_keys || i % 3 == 0) {
+      index_key.SetFromInteger(10 * i);
+      EXPECT_EQ(true, skiplist.Remove(index_key));
+    }
+  }
+
+  std::vector<int64_t> forward;
+  for (auto iter : skiplist) {
+    forward.push_back(iter.first.ToInteger());
+  }
+  std::vector<int64_t> backward;
+  for (auto iter = skiplist.rbegin(); iter != skiplist.rend(); ++iter) {
+    backward.push_back((*iter).first.ToInteger());
+  }
+  std::reverse(backward.begin(), backward.end());
+  EXPECT_EQ(forward, backward);
+  EXPECT_EQ(forward.size(), skiplist.Size());
+
+  // SeekForPrev lands on the last key <= target, and -- walks on from there
+  index_key.SetFromInteger(5);
+  EXPECT_EQ(skiplist.SeekForPrev(index_key), skiplist.end());
+  index_key.SetFromInteger(10 * scale_keys + 5);
+  EXPECT_EQ((*skiplist.SeekForPrev(index_key)).first.ToInteger(), 10 * (scale_keys - 2));  // 9990 was dropped
+  index_key.SetFromInteger(305);  // 300 was dropped
+  auto iter = skiplist.SeekForPrev(index_key);
+  EXPECT_EQ((*iter).first.ToInteger(), 290);
+  EXPECT_EQ((*--iter).first.ToInteger(), 280);
+  EXPECT_EQ((*--iter).first.ToInteger(), 260);
+  index_key.SetFromInteger(20);
+  iter = skiplist.SeekForPrev(index_key);
+  EXPECT_EQ(iter, skiplist.begin());
+  EXPECT_EQ((*--skiplist.end()).first.ToInteger(), 10 * (scale_keys - 2));  // 9990 was dropped
+}
+
+TEST(SkipListTest, FilterTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  std::vector<GenericValue<8>> result;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  // even keys, half of them inserted before the filter exists; the rest make it grow once
+  int scale_keys = 20000;
+  for (int i = 0; i < scale_keys / 2; i++) {
+    index_key.SetFromInteger(2 * i);
+    index_value.SetFromInteger(2 * i);
+    skiplist.Insert(index_key, index_value);
+  }
+  skiplist.EnableFilter(scale_keys / 4);
+  for (int i = scale_keys / 2; i < scale_keys; i++) {
+    index_key.SetFromInteger(2 * i);
+    index_value.SetFromInteger(2 * i);
+    skiplist.Insert(index_key, index_value);
+  }
+  // removed keys must stop matching, and the counters of their neighbours must survive
+  for (int i = 0; i < scale_keys; i += 4) {
+    index_key.SetFromInteger(2 * i);
+    EXPECT_EQ(true, skiplist.Remove(index_key));
+  }
+  for (int i = 0; i < scale_keys; i++) {
+    result.clear();
+    index_key.SetFromInteger(2 * i);
+    EXPECT_EQ(i % 4 != 0, skiplist.Lookup(index_key, &result));
+  }
+  // odd keys were never inserted
+  for (int i = 0; i < scale_keys; i++) {
+    index_key.SetFromInteger(2 * i + 1);
+    EXPECT_EQ(false, skiplist.Lookup(index_key, &result));
+  }
+  EXPECT_LT(skiplist.FilterFalsePositiveRate(), 0.05);
+  EXPECT_GT(skiplist.FilterBitsPerKey(), 0);
+
+  skiplist.Clear();
+  index_key.SetFromInteger(2);
+  EXPECT_EQ(false, skiplist.Lookup(index_key, &result));
+  index_value.SetFromInteger(2);
+  skiplist.Insert(index_key, index_value);
+  EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+}
+
+TEST(SkipListTest, LearnedIndexTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  std::vector<GenericValue<8>> result;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  // skewed keys, with negative ones and gaps for the absent probes
+  std::mt19937 gen(0xdeadbeef);
+  std::lognormal_distribution<double> lognormal(0, 2);
+  std::set<int64_t> key_set;
+  while (key_set.size() < 20000) {
+    auto key = static_cast<int64_t>(lognormal(gen) * 1e6) * 2;
+    key_set.insert(key_set.size() % 2 == 0 ? key : -key);
+  }
+  std::vector<int64_t> keys(key_set.begin(), key_set.end());
+  std::shuffle(keys.begin(), keys.end(), gen);
+  auto check = [&]() {
+    for (auto key : key_set) {
+      result.clear();
+      index_key.SetFromInteger(key);
+      EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+      EXPECT_EQ(key, result[0].ToInteger());
+      index_key.SetFromInteger(key + 1);
+      EXPECT_EQ(false, skiplist.Lookup(index_key, &result));
+    }
+  };
+  // half before training, half after, which refits segments a few times
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i == keys.size() / 2) {
+      skiplist.EnableLearnedIndex(true, 2, 8);
+      EXPECT_GT(skiplist.LearnedSegments(), 0);
+    }
+    index_key.SetFromInteger(keys[i]);
+    index_value.SetFromInteger(keys[i]);
+    skiplist.Insert(index_key, index_value);
+  }
+  check();
+  // removed anchors are patched over, one by one and in bulk
+  for (size_t i = 0; i < keys.size(); i += 3) {
+    index_key.SetFromInteger(keys[i]);
+    EXPECT_EQ(true, skiplist.Remove(index_key));
+    key_set.erase(keys[i]);
+  }
+  check();
+  GenericKey<8> end_key;
+  index_key.SetFromInteger(-1000000);
+  end_key.SetFromInteger(3000000);
+  skiplist.RemoveRange(index_key, end_key);
+  key_set.erase(key_set.lower_bound(-1000000), key_set.lower_bound(3000000));
+  check();
+  // and whatever Insert and Remove do next keeps it right
+  for (size_t i = 0; i < keys.size(); i += 3) {
+    index_key.SetFromInteger(keys[i]);
+    index_value.SetFromInteger(keys[i]);
+    skiplist.Insert(index_key, index_value);
+    key_set.insert(keys[i]);
+  }
+  check();
+  // churn, which refits segments one at a time while lookups keep going
+  for (int i = 0; i < 100000; i++) {
+    auto key = keys[gen() % keys.size()];
+    index_key.SetFromInteger(key);
+    if (key_set.count(key) != 0) {
+      EXPECT_EQ(true, skiplist.Remove(index_key));
+      key_set.erase(key);
+    } else {
+      index_value.SetFromInteger(key);
+      EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+      key_set.insert(key);
+    }
+    key = keys[gen() % keys.size()];
+    index_key.SetFromInteger(key);
+    result.clear();
+    EXPECT_EQ(key_set.count(key) != 0, skiplist.Lookup(index_key, &result));
+  }
+  EXPECT_GT(skiplist.LearnedSegments(), 0);
+  check();
+
+  // Split and Join retrain
+  index_key.SetFromInteger(0);
+  auto right = skiplist.Split(index_key);
+  EXPECT_EQ(true, skiplist.Join(right.get()));
+  check();
+
+  skiplist.EnableLearnedIndex(false);
+  EXPECT_EQ(0, skiplist.LearnedSegments());
+  check();
+  skiplist.EnableLearnedIndex(true);
+  skiplist.Clear();
+  index_key.SetFromInteger(2);
+  EXPECT_EQ(false, skiplist.Lookup(index_key, &result));
+  index_value.SetFromInteger(2);
+  skiplist.Insert(index_key, index_value);
+  EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+
+  // a list of height 1 has nothing for the model to stand in for, and keeps finding keys inserted afterwards
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> flat(comparator, 1);
+  for (int64_t key = 0; key < 1000; key += 2) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key);
+    flat.Insert(index_key, index_value);
+  }
+  flat.EnableLearnedIndex(true);
+  EXPECT_EQ(0, flat.LearnedSegments());
+  for (int64_t key = 1; key < 1000; key += 2) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key);
+    flat.Insert(index_key, index_value);
+  }
+  for (int64_t key = 0; key < 1000; key++) {
+    result.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_EQ(true, flat.Lookup(index_key, &result));
+  }
+}
+
+TEST(SkipListTest, ChangeFeedTest) {
+  using Record = ChangeRecord<GenericKey<8>, GenericValue<8>>;
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  EXPECT_EQ(nullptr, skiplist.Subscribe());
+  skiplist.EnableChangeFeed(64);
+  auto subscriber = skiplist.Subscribe();
+
+  // only the changes that happen make records
+  for (int i = 0; i < 10; i++) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i * 10);
+    skiplist.Insert(index_key, index_value);
+  }
+  index_key.SetFromInteger(3);
+  skiplist.Insert(index_key, index_value);
+  EXPECT_EQ(true, skiplist.Remove(index_key));
+  EXPECT_EQ(false, skiplist.Remove(index_key));
+  EXPECT_EQ(11, subscriber->Lag());
+  std::vector<Record> records;
+  EXPECT_EQ(4, subscriber->Poll(&records, 4));
+  EXPECT_EQ(7, subscriber->Poll(&records, 100));
+  EXPECT_EQ(0, subscriber->Poll(&records, 100));
+  EXPECT_EQ(0, subscriber->Lag());
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(static_cast<uint64_t>(i), records[i].seq_);
+    EXPECT_EQ(ChangeOp::INSERT, records[i].op_);
+    EXPECT_EQ(i, records[i].key_.ToInteger());
+    EXPECT_EQ(i * 10, records[i].value_.ToInteger());
+  }
+  EXPECT_EQ(ChangeOp::REMOVE, records[10].op_);
+  EXPECT_EQ(3, records[10].key_.ToInteger());
+  EXPECT_EQ(30, records[10].value_.ToInteger());
+
+  // a range goes one record per key, Split and Join likewise; a late subscriber sees only what follows it
+  GenericKey<8> end_key;
+  index_key.SetFromInteger(5);
+  end_key.SetFromInteger(8);
+  EXPECT_EQ(3, skiplist.RemoveRange(index_key, end_key));
+  auto late = skiplist.Subscribe();
+  index_key.SetFromInteger(8);
+  auto right = skiplist.Split(index_key);
+  EXPECT_EQ(true, skiplist.Join(right.get()));
+  skiplist.Clear();
+  records.clear();
+  EXPECT_EQ(8, subscriber->Poll(&records, 100));
+  std::vector<std::pair<ChangeOp, int64_t>> expected = {
+      {ChangeOp::REMOVE, 5}, {ChangeOp::REMOVE, 6}, {ChangeOp::REMOVE, 7}, {ChangeOp::REMOVE, 8},
+      {ChangeOp::REMOVE, 9}, {ChangeOp::INSERT, 8}, {ChangeOp::INSERT, 9}, {ChangeOp::CLEAR, 0}};
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(expected[i].first, records[i].op_);
+    if (expected[i].first != ChangeOp::CLEAR) {
+      EXPECT_EQ(expected[i].second, records[i].key_.ToInteger());
+    }
+  }
+  EXPECT_EQ(5, late->Lag());
+
+  // a subscriber a whole ring behind loses the oldest records, and says so until it resyncs
+  for (int i = 0; i < 100; i++) {
+    index_key.SetFromInteger(i);
+    skiplist.Insert(index_key, index_value);
+  }
+  records.clear();
+  EXPECT_EQ(64, subscriber->Poll(&records, 1000));
+  EXPECT_EQ(true, subscriber->Overflowed());
+  EXPECT_EQ(36, subscriber->Dropped());
+  EXPECT_EQ(36, records[0].key_.ToInteger());
+  subscriber->Resync();
+  EXPECT_EQ(false, subscriber->Overflowed());
+  index_key.SetFromInteger(100);
+  skiplist.Insert(index_key, index_value);
+  records.clear();
+  EXPECT_EQ(1, subscriber->Poll(&records, 1000));
+  EXPECT_EQ(100, records[0].key_.ToInteger());
+}
+
+TEST(SkipListTest, TTLTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  std::vector<GenericValue<8>> result;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  // even keys live forever, odd keys expire almost at once
+  int scale_keys = 1000;
+  for (int i = 0; i < scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    if (i % 2 == 0) {
+      EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+    } else {
+      EXPECT_EQ(true, skiplist.InsertWithTTL(index_key, index_value, std::chrono::milliseconds(20)));
+    }
+  }
+  index_key.SetFromInteger(1);
+  EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+  EXPECT_EQ(false, skiplist.InsertWithTTL(index_key, index_value, std::chrono::milliseconds(20)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(40));
+
+  // expired entries read as absent before any eviction, and can be inserted again
+  for (int i = 0; i < scale_keys; i++) {
+    result.clear();
+    index_key.SetFromInteger(i);
+    EXPECT_EQ(i % 2 == 0, skiplist.Lookup(index_key, &result));
+  }
+  EXPECT_EQ(skiplist.Size(), scale_keys);
+  index_key.SetFromInteger(1);
+  index_value.SetFromInteger(100);
+  EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+  EXPECT_EQ(skiplist.Size(), scale_keys);
+
+  // eviction works in bounded slices and skips the replaced entry
+  EXPECT_EQ(skiplist.EvictExpired(100), 100);
+  EXPECT_EQ(skiplist.EvictExpired(scale_keys), scale_keys / 2 - 101);
+  EXPECT_EQ(skiplist.EvictExpired(scale_keys), 0);
+  EXPECT_EQ(skiplist.Size(), scale_keys / 2 + 1);
+  result.clear();
+  EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+  EXPECT_EQ(result[0].ToInteger(), 100);
+
+  // the sweeper finds the rest on its own
+  for (int i = scale_keys; i < 2 * scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    skiplist.InsertWithTTL(index_key, index_value, std::chrono::milliseconds(10));
+  }
+  size_t live_keys = scale_keys / 2 + 1;
+  skiplist.StartSweeper(std::chrono::milliseconds(5), 16);
+  for (int wait = 0; wait < 200 && skiplist.Size() != live_keys; wait++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  skiplist.StopSweeper();
+  EXPECT_EQ(skiplist.Size(), live_keys);
+}
+
+TEST(SkipListTest, MemoryLimitTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  // every node costs at least its key, value and one link
+  size_t empty_usage = skiplist.ApproximateMemoryUsage();
+  EXPECT_GT(empty_usage, 0);
+  int scale_keys = 1000;
+  for (int i = 0; i < scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    skiplist.Insert(index_key, index_value);
+  }
+  size_t node_usage = skiplist.ApproximateMemoryUsage() - empty_usage;
+  EXPECT_GE(node_usage, scale_keys * (sizeof(GenericKey<8>) + sizeof(GenericValue<8>) + sizeof(void *)));
+
+  // removed nodes are reused rather than counted again
+  for (int i = 0; i < scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    skiplist.Remove(index_key);
+  }
+  for (int i = 0; i < scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    skiplist.Insert(index_key, index_value);
+  }
+  EXPECT_LE(skiplist.ApproximateMemoryUsage(), empty_usage + 2 * node_usage);
+
+  // fill up to a budget of twice the current usage
+  int full_signals = 0;
+  size_t limit = 2 * skiplist.ApproximateMemoryUsage();
+  skiplist.SetMemoryLimit(limit, [&full_signals]() { full_signals++; });
+  int inserted = 0;
+  for (int i = scale_keys; i < 100 * scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    if (!skiplist.Insert(index_key, index_value)) {
+      break;
+    }
+    inserted++;
+  }
+  EXPECT_GT(inserted, 0);
+  EXPECT_LT(inserted, 100 * scale_keys - scale_keys);
+  EXPECT_EQ(true, skiplist.Full());
+  EXPECT_GE(skiplist.ApproximateMemoryUsage(), limit);
+  EXPECT_EQ(false, skiplist.Emplace(index_key, index_value));
+  EXPECT_EQ(full_signals, 1);
+
+  // Clear gives the budget back and re-arms the signal
+  skiplist.Clear();
+  EXPECT_EQ(skiplist.ApproximateMemoryUsage(), empty_usage);
+  EXPECT_EQ(false, skiplist.Full());
+  EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+}
+
+TEST(SkipListTest, HugePageTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  std::vector<GenericValue<8>> result;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+  EXPECT_EQ(true, skiplist.UseHugePages(true));
+
+  int scale_keys = 10000;
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < scale_keys; i++) {
+      index_key.SetFromInteger(i);
+      index_value.SetFromInteger(i);
+      EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+    }
+    for (int i = 0; i < scale_keys; i++) {
+      result.clear();
+      index_key.SetFromInteger(i);
+      EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+      EXPECT_EQ(result[0].ToInteger(), i);
+    }
+    // the page mode survives both ways of emptying the list
+    if (round == 0) {
+      EXPECT_EQ(false, skiplist.UseHugePages());
+      skiplist.Clear();
+    } else {
+      skiplist.Reset();
+    }
+  }
+}
+
+TEST(SkipListTest, AccessBiasTest) {
+  GenericComparator<8> comparator;
+  int max_height = 12;
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  std::vector<GenericValue<8>> result;
+  SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, max_height);
+
+  int scale_keys = 10000;
+  for (int i = 0; i < scale_keys; i++) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    if (i == 3) {
+      EXPECT_EQ(true, skiplist.InsertWithTTL(index_key, index_value, std::chrono::milliseconds(50)));
+    } else {
+      EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+    }
+  }
+  // re-heighted nodes keep their place, their value and the positional links around them
+  auto verify = [&](int size) {
+    EXPECT_EQ(skiplist.Size(), size);
+    int64_t expected = 0;
+    for (auto iter : skiplist) {
+      EXPECT_EQ(iter.first.ToInteger(), expected);
+      EXPECT_EQ(iter.second.ToInteger(), expected);
+      expected++;
+    }
+    EXPECT_EQ(expected, size);
+    for (int i = 0; i < size; i += 7) {
+      index_key.SetFromInteger(i);
+      EXPECT_EQ(skiplist.Rank(index_key), i);
+      EXPECT_EQ(true, skiplist.Select(i, &index_key, &index_value));
+      EXPECT_EQ(index_key.ToInteger(), i);
+    }
+  };
+
+  // every lookup counts; key k of the first 16 is looked up 16 - k times as often as key 15
+  skiplist.SetAccessBias(true, 1);
+  auto hammer = [&](int first) {
+    for (int k = 0; k < 16; k++) {
+      for (int n = 0; n < 10 * (16 - k); n++) {
+        result.clear();
+        index_key.SetFromInteger(first + k);
+        EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+      }
+    }
+  };
+  hammer(0);
+  skiplist.Rebalance(16);
+  verify(scale_keys);
+
+  // the hot set moves; the old one is demoted over the next rounds as its counts decay
+  for (int round = 0; round < 4; round++) {
+    hammer(5000);
+    skiplist.Rebalance(16);
+    verify(scale_keys);
+  }
+  index_key.SetFromInteger(5000);
+  index_value.SetFromInteger(5000);
+  EXPECT_EQ(true, skiplist.Remove(index_key));
+  EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+
+  // a promoted TTL entry still expires
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  index_key.SetFromInteger(3);
+  result.clear();
+  EXPECT_EQ(false, skiplist.Lookup(index_key, &result));
+  EXPECT_EQ(skiplist.EvictExpired(scale_keys), 1);
+  index_value.SetFromInteger(3);
+  EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+
+  // the background rebalancer works alongside lookups
+  skiplist.StartRebalancer(std::chrono::milliseconds(1), 16);
+  for (int round = 0; round < 20; round++) {
+    hammer(round * 100);
+  }
+  skiplist.StopRebalancer();
+  verify(scale_keys);
+}
+}  // namespace skiplist
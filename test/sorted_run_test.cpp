@@ -0,0 +1,220 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "generic_key.h"
+#include "gtest/gtest.h"
+#include "merging_iterator.h"
+#include "skiplist.h"
+#include "sorted_run.h"
+
+namespace skiplist {
+using TestList = SkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+using TestRun = SortedRun<GenericKey<8>, GenericValue<8>, GenericComparator<8>>;
+
+void InsertRange(TestList *skiplist, int64_t begin, int64_t end, int64_t step, int64_t value_offset) {
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  for (int64_t key = begin; key < end; key += step) {
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key + value_offset);
+    skiplist->Insert(index_key, index_value);
+  }
+}
+
+TEST(SortedRunTest, EmptyTest) {
+  GenericComparator<8> comparator;
+  TestList skiplist(comparator, 5);
+  std::string file_name = "sorted_run_empty_test.sst";
+  EXPECT_EQ(true, skiplist.Flush(file_name));
+  auto run = TestRun::Open(file_name, comparator);
+  ASSERT_NE(run, nullptr);
+  EXPECT_EQ(run->Size(), 0);
+  EXPECT_EQ(run->BlockCount(), 0);
+  GenericKey<8> index_key;
+  index_key.SetFromInteger(1);
+  std::vector<GenericValue<8>> result;
+  EXPECT_EQ(false, run->Lookup(index_key, &result));
+  auto iter = run->NewIterator();
+  iter.SeekToFirst();
+  EXPECT_EQ(false, iter.Valid());
+  std::remove(file_name.c_str());
+
+  EXPECT_EQ(TestRun::Open("no_such_file.sst", comparator), nullptr);
+}
+
+TEST(SortedRunTest, FlushLookupTest) {
+  GenericComparator<8> comparator;
+  TestList skiplist(comparator, 12);
+  // odd keys only, so every even key is a miss inside some block
+  int scale_keys = 10000;
+  InsertRange(&skiplist, 1, 2 * scale_keys, 2, 0);
+
+  size_t raw_file_size = 0;
+  for (bool compress : {false, true}) {
+    std::string file_name = "sorted_run_lookup_test.sst";
+    EXPECT_EQ(true, skiplist.Flush(file_name, compress));
+    auto run = TestRun::Open(file_name, comparator);
+    ASSERT_NE(run, nullptr);
+    EXPECT_EQ(run->Size(), scale_keys);
+    EXPECT_GT(run->BlockCount(), 1);
+#ifdef SKIPLIST_HAVE_ZLIB
+    if (compress) {
+      EXPECT_LT(run->FileSize(), raw_file_size);
+    }
+#endif
+    raw_file_size = run->FileSize();
+
+    GenericKey<8> index_key;
+    std::vector<GenericValue<8>> result;
+    for (int i = 0; i <= 2 * scale_keys; i++) {
+      result.clear();
+      index_key.SetFromInteger(i);
+      EXPECT_EQ(i % 2 == 1, run->Lookup(index_key, &result));
+      if (i % 2 == 1) {
+        EXPECT_EQ(result[0].ToInteger(), i);
+      }
+    }
+
+    // a full scan sees every key in order, Seek lands on the first key >= target
+    auto iter = run->NewIterator();
+    int64_t expected = 1;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+      EXPECT_EQ(iter.Key().ToInteger(), expected);
+      EXPECT_EQ(iter.Value().ToInteger(), expected);
+      expected += 2;
+    }
+    EXPECT_EQ(expected, 2 * scale_keys + 1);
+    for (int i = 0; i < 2 * scale_keys; i += 37) {
+      index_key.SetFromInteger(i);
+      iter.Seek(index_key);
+      ASSERT_EQ(true, iter.Valid());
+      EXPECT_EQ(iter.Key().ToInteger(), i % 2 == 1 ? i : i + 1);
+    }
+    index_key.SetFromInteger(2 * scale_keys);
+    iter.Seek(index_key);
+    EXPECT_EQ(false, iter.Valid());
+    std::remove(file_name.c_str());
+  }
+}
+
+TEST(SortedRunTest, MergingIteratorTest) {
+  GenericComparator<8> comparator;
+  // newest: multiples of 3, value + 1000000; middle: multiples of 2, value + 1000; oldest on disk: every key
+  TestList newest(comparator, 12);
+  TestList middle(comparator, 12);
+  TestList oldest(comparator, 12);
+  int scale_keys = 3000;
+  InsertRange(&newest, 0, scale_keys, 3, 1000000);
+  InsertRange(&middle, 0, scale_keys, 2, 1000);
+  InsertRange(&oldest, 0, scale_keys, 1, 0);
+  std::string file_name = "sorted_run_merge_test.sst";
+  EXPECT_EQ(true, oldest.Flush(file_name));
+  auto run = TestRun::Open(file_name, comparator);
+  ASSERT_NE(run, nullptr);
+
+  MergingIterator<GenericKey<8>, GenericValue<8>, GenericComparator<8>> iter(comparator);
+  iter.AddList(&newest);
+  iter.AddList(&middle);
+  iter.AddRun(run.get());
+  int64_t expected = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    EXPECT_EQ(iter.Key().ToInteger(), expected);
+    int64_t offset = expected % 3 == 0 ? 1000000 : (expected % 2 == 0 ? 1000 : 0);
+    EXPECT_EQ(iter.Value().ToInteger(), expected + offset);
+    expected++;
+  }
+  EXPECT_EQ(expected, scale_keys);
+
+  GenericKey<8> index_key;
+  index_key.SetFromInteger(1001);
+  iter.Seek(index_key);
+  EXPECT_EQ(iter.Key().ToInteger(), 1001);
+  iter.Next();
+  EXPECT_EQ(iter.Key().ToInteger(), 1002);
+  EXPECT_EQ(iter.Value().ToInteger(), 1002 + 1000000);
+  std::remove(file_name.c_str());
+}
+
+// Overwrite the bytes at offset with value.
+void PatchFile(const std::string &file_name, size_t offset, uint32_t value, size_t length) {
+  std::fstream file(file_name, std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(offset);
+  file.write(reinterpret_cast<const char *>(&value), length);
+}
+
+// A malformed entry or restart offset makes lookups miss and iterators stop, instead of reading past the block.
+TEST(SortedRunTest, CorruptedBlockTest) {
+  GenericComparator<8> comparator;
+  std::string file_name = "sorted_run_corrupted_test.sst";
+  const size_t block_bytes_end = 5 + sizeof(GenericKey<8>) + 2 * sizeof(uint64_t) + 40;  // trailer, index, footer
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  std::vector<GenericValue<8>> result;
+  // 0: the first entry claims more key bytes than a key has, 1: the last restart points past the entries
+  for (int corruption : {0, 1}) {
+    {
+      SortedRunWriter<GenericKey<8>, GenericValue<8>, GenericComparator<8>> writer(file_name, comparator, 4096, 4);
+      for (int64_t key = 0; key < 32; key++) {
+        index_key.SetFromInteger(key);
+        index_value.SetFromInteger(key);
+        EXPECT_EQ(true, writer.Add(index_key, index_value));
+      }
+      EXPECT_EQ(true, writer.Finish());
+    }
+    {
+      auto run = TestRun::Open(file_name, comparator);
+      ASSERT_NE(run, nullptr);
+      ASSERT_EQ(run->BlockCount(), 1);
+      size_t block_end = run->FileSize() - block_bytes_end;
+      if (corruption == 0) {
+        PatchFile(file_name, sizeof(uint16_t), UINT16_MAX, sizeof(uint16_t));
+      } else {
+        PatchFile(file_name, block_end - 2 * sizeof(uint32_t), block_end, sizeof(uint32_t));
+      }
+    }
+    auto run = TestRun::Open(file_name, comparator);
+    ASSERT_NE(run, nullptr);
+    index_key.SetFromInteger(0);
+    EXPECT_EQ(false, run->Lookup(index_key, &result));
+    // Only the corrupted entry is lost to a lookup that starts past it.
+    index_key.SetFromInteger(31);
+    EXPECT_EQ(corruption == 0, run->Lookup(index_key, &result));
+    auto iter = run->NewIterator();
+    if (corruption == 0) {
+      iter.SeekToFirst();
+      EXPECT_EQ(false, iter.Valid());
+    }
+    index_key.SetFromInteger(31);
+    iter.Seek(index_key);
+    EXPECT_EQ(false, iter.Valid());
+  }
+  std::remove(file_name.c_str());
+}
+
+// Lookups keep being served while a sealed memtable is flushed
+TEST(SortedRunTest, FlushWhileReadingTest) {
+  GenericComparator<8> comparator;
+  TestList skiplist(comparator, 16);
+  int scale_keys = 100000;
+  InsertRange(&skiplist, 0, scale_keys, 1, 0);
+  std::string file_name = "sorted_run_background_test.sst";
+  bool flushed = false;
+  std::thread flusher([&] { flushed = skiplist.Flush(file_name); });
+  GenericKey<8> index_key;
+  std::vector<GenericValue<8>> result;
+  for (int i = 0; i < scale_keys; i++) {
+    result.clear();
+    index_key.SetFromInteger(i);
+    EXPECT_EQ(true, skiplist.Lookup(index_key, &result));
+  }
+  flusher.join();
+  EXPECT_EQ(true, flushed);
+  auto run = TestRun::Open(file_name, comparator);
+  ASSERT_NE(run, nullptr);
+  EXPECT_EQ(run->Size(), scale_keys);
+  std::remove(file_name.c_str());
+}
+}  // namespace skiplist
@@ -0,0 +1,89 @@
+#include <set>
+#include <vector>
+
+#include "generic_key.h"
+#include "gtest/gtest.h"
+#include "unrolled_skiplist.h"
+
+namespace skiplist {
+TEST(UnrolledSkipListTest, EmptyTest) {
+  GenericComparator<8> comparator;
+  UnrolledSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, 5);
+  EXPECT_EQ(skiplist.Size(), 0);
+  std::vector<GenericValue<8>> result;
+  GenericKey<8> index_key;
+  index_key.SetFromInteger(0);
+  EXPECT_EQ(false, skiplist.Lookup(index_key, &result));
+  EXPECT_EQ(false, skiplist.Remove(index_key));
+  EXPECT_EQ(skiplist.begin(), skiplist.end());
+}
+
+TEST(UnrolledSkipListTest, InsertTest) {
+  GenericComparator<8> comparator;
+  UnrolledSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, 8);
+
+  // descending inserts always hit the front of the first node
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  int scale_keys = 1000;
+  for (int i = scale_keys; i >= 1; i--) {
+    index_key.SetFromInteger(i);
+    index_value.SetFromInteger(i);
+    EXPECT_EQ(true, skiplist.Insert(index_key, index_value));
+    EXPECT_EQ(false, skiplist.Insert(index_key, index_value));
+  }
+  EXPECT_EQ(skiplist.Size(), scale_keys);
+  EXPECT_LE(skiplist.NodeCount(), scale_keys / (UnrolledSkipList<GenericKey<8>, GenericValue<8>,
+                                                                 GenericComparator<8>>::NODE_CAPACITY / 2));
+
+  std::vector<GenericValue<8>> result;
+  for (int i = 0; i <= scale_keys + 1; i++) {
+    index_key.SetFromInteger(i);
+    result.clear();
+    EXPECT_EQ(i >= 1 && i <= scale_keys, skiplist.Lookup(index_key, &result));
+  }
+
+  int i = 1;
+  for (auto iter : skiplist) {
+    EXPECT_EQ(iter.first.ToInteger(), i);
+    EXPECT_EQ(iter.second.ToInteger(), i);
+    i++;
+  }
+  EXPECT_EQ(i, scale_keys + 1);
+}
+
+TEST(UnrolledSkipListTest, MixTest) {
+  GenericComparator<8> comparator;
+  UnrolledSkipList<GenericKey<8>, GenericValue<8>, GenericComparator<8>> skiplist(comparator, 8);
+  std::set<int64_t> expected;
+
+  GenericKey<8> index_key;
+  GenericValue<8> index_value;
+  srand(0x3f3f3f3f);
+  for (int round = 0; round < 20000; round++) {
+    int64_t key = rand() % 2000;
+    index_key.SetFromInteger(key);
+    index_value.SetFromInteger(key);
+    if (rand() % 3 == 0) {
+      EXPECT_EQ(expected.erase(key) == 1, skiplist.Remove(index_key));
+    } else {
+      EXPECT_EQ(expected.insert(key).second, skiplist.Insert(index_key, index_value));
+    }
+  }
+  EXPECT_EQ(skiplist.Size(), expected.size());
+
+  auto expected_iter = expected.begin();
+  for (auto iter : skiplist) {
+    EXPECT_EQ(iter.first.ToInteger(), *expected_iter);
+    ++expected_iter;
+  }
+  EXPECT_EQ(expected_iter, expected.end());
+
+  for (auto key : expected) {
+    index_key.SetFromInteger(key);
+    EXPECT_EQ(true, skiplist.Remove(index_key));
+  }
+  EXPECT_EQ(skiplist.Size(), 0);
+  EXPECT_EQ(skiplist.NodeCount(), 0);
+}
+}  // namespace skiplist